@@ -1,13 +1,16 @@
 #include <algorithm>
+#include <limits>
+#include <boost/bind.hpp>
 #include "artsegment.h"
 
 namespace Art_Segment
 {
 //// helpers
-bool neuronScoreComp(Neuron * p1, Neuron * p2)
-{
-    return p1->getCurScore() < p2->getCurScore();
-}
+// rgbEulerDistance d of rgb pixels against the norm L(v) = sqrt(2r^2 + 4g^2 + 2b^2) of
+// their (unrounded) difference v: L(v) - ERROR < d <= SCALE * L(v), see tryLastWinner.
+// Rounded up, which also covers the doubles' rounding of the weight moves.
+const double ART_FAST_PATH_SCALE = 1.22475; // sqrt(1.5)
+const double ART_FAST_PATH_ERROR = 2.82843; // sqrt(8)
 
 double bgDistanceTobgProbability(const double bgDistance)
 {
@@ -21,8 +24,137 @@ double bgDistanceTobgProbability(const double bgDistance)
         return 0.0;
 }
 
+// snapshot record of one neuron: weight vector (rgb), then the fields in Neuron's order
+int saveNeuron(Seg_Three::SnapshotWriter & writer, Neuron & neuron)
+{
+    return writer.write(neuron.getWeights().components().data(),
+                        ART_WEIGHT_DIM * sizeof(double)) |
+           writer.writeValue(neuron.getLearningRate()) |
+           writer.writeValue(neuron.getCurVigilance()) |
+           writer.writeValue(neuron.getAges()) |
+           writer.writeValue(neuron.getCurScore()) |
+           writer.writeValue(neuron.getScoreBits());
+}
+
+int loadNeuron(Seg_Three::SnapshotReader & reader, Neuron & neuron)
+{
+    std::array<double, ART_WEIGHT_DIM> weights = {{0.0}};
+    double learningRate = 0.0, vigilance = 0.0;
+    unsigned int liveTimes = 0, curScore = 0, scoreBits = 0;
+    if ((reader.read(weights.data(), sizeof(weights)) | reader.readValue(learningRate) |
+         reader.readValue(vigilance) | reader.readValue(liveTimes) |
+         reader.readValue(curScore) | reader.readValue(scoreBits)) != 0)
+        return -1;
+    neuron.reset(ArtVector(weights));
+    neuron.setLearningRate(learningRate);
+    neuron.setVigilance(vigilance);
+    neuron.setAges(liveTimes);
+    neuron.setCurScore(curScore);
+    neuron.setScoreBits(scoreBits);
+    return 0;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////
 //// ArtNN class method
+/**** saveState / loadState:
+ inputFrames, winner (bBGWin, winnerIdx), bg neuron count, moving neuron count, then
+ the bg & moving neurons. return value: < 0 write/read err
+****/
+int ArtNN :: saveState(Seg_Three::SnapshotWriter & writer)
+{
+    settleLosers(m_inputFrames);
+    const int bBGWin = m_bBGWin ? 1 : 0;
+    const unsigned int bgNum = m_bgNum;
+    const unsigned int movingNum = m_movingNum;
+    int ret = writer.writeValue(m_inputFrames) | writer.writeValue(bBGWin) |
+              writer.writeValue(m_winnerIdx) | writer.writeValue(bgNum) |
+              writer.writeValue(movingNum);
+    for (int k = 0; k < m_bgNum; k++)
+        ret |= saveNeuron(writer, bgNeuron(k));
+    for (int k = 0; k < m_movingNum; k++)
+        ret |= saveNeuron(writer, movingNeuron(k));
+    return ret;
+}
+
+int ArtNN :: loadState(Seg_Three::SnapshotReader & reader)
+{
+    int bBGWin = 0;
+    unsigned int bgNum = 0, movingNum = 0;
+    if ((reader.readValue(m_inputFrames) | reader.readValue(bBGWin) |
+         reader.readValue(m_winnerIdx) | reader.readValue(bgNum) |
+         reader.readValue(movingNum)) != 0)
+        return -1;
+    if (bgNum + movingNum > (unsigned int)m_slotNum)
+        return -1;
+    m_bBGWin = bBGWin != 0;
+    m_winnerClearance = 0.0;
+    m_nextDeathCheck = 0;
+    setMergePeriod(m_mergePeriod);
+    m_bgNum = m_movingNum = 0;
+    for (unsigned int k = 0; k < bgNum + movingNum; k++)
+    {
+        if (loadNeuron(reader, m_pSlots[k]) < 0)
+            return -1;
+        if (k < bgNum)
+            m_bgSlots[m_bgNum++] = k;
+        else
+            m_movingSlots[m_movingNum++] = k;
+    }
+    return 0;
+}
+
+/**** takeFreeSlot:
+ 1. a slot neither group uses, if the budget has a neuron left (the first is free)
+ 2. all taken: evict the lowest scoring moving neuron, or bg neuron if no moving ones
+ 3. return value: the slot index
+****/
+int ArtNN :: takeFreeSlot()
+{
+    const int neuronNum = m_bgNum + m_movingNum;
+    if (neuronNum == 0 || (neuronNum < m_slotNum && m_pBudget->take()))
+    {
+        unsigned int usedSlots = 0;
+        for (int k = 0; k < m_bgNum; k++)
+            usedSlots |= 1u << m_bgSlots[k];
+        for (int k = 0; k < m_movingNum; k++)
+            usedSlots |= 1u << m_movingSlots[k];
+        int slot = 0;
+        while (usedSlots & (1u << slot))
+            slot++;
+        return slot;
+    }
+
+    m_evictions++;
+    unsigned char * slots = m_movingNum > 0 ? m_movingSlots : m_bgSlots;
+    unsigned char & num = m_movingNum > 0 ? m_movingNum : m_bgNum;
+    int victim = 0;
+    for (int k = 1; k < num; k++)
+        if (m_pSlots[slots[k]].getCurScore() < m_pSlots[slots[victim]].getCurScore())
+            victim = k;
+    const int slot = slots[victim];
+    removeNeuron(slots, num, victim);
+    return slot;
+}
+
+// drop the k-th neuron of a group, keeping the others' order
+void ArtNN :: removeNeuron(unsigned char * slots, unsigned char & num, const int k)
+{
+    for (int n = k + 1; n < num; n++)
+        slots[n - 1] = slots[n];
+    num--;
+    m_winnerClearance = 0.0;
+    return;
+}
+
+// removeNeuron for good: the neuron's slot goes back to the net & the budget
+void ArtNN :: dropNeuron(unsigned char * slots, unsigned char & num, const int k)
+{
+    removeNeuron(slots, num, k);
+    if (m_bgNum + m_movingNum > 0)
+        m_pBudget->release();
+    return;
+}
+
 /**** processOneInput:
  1. classify the input pixel as background or foreground probability
  2. update its internal neurons' states.
@@ -30,9 +162,15 @@ double bgDistanceTobgProbability(const double bgDistance)
  4. return value: < 0: process error; >= 0 process ok
                   set selfProbability 
 ****/
-double ArtNN :: processOneInput(const VectorSpace<double> & input)
+double ArtNN :: processOneInput(const ArtVector & input)
 {
     m_inputFrames++;
+    // 0. the last winner surely wins again: the others only lose, nothing to rearrange
+    //    (merge rounds always rearrange)
+    double fastDistance = 0.0;
+    if (m_bFastPath == true && (m_mergePeriod == 0 || m_inputFrames < m_nextMerge) &&
+        tryLastWinner(input, fastDistance) == true)
+        return bgDistanceTobgProbability(fastDistance);
     double bgProbability = 0.0;
     // 1. update neurons internal scores by new coming input 
     //    in this step all neurons are treated as losers.
@@ -45,55 +183,95 @@ double ArtNN :: processOneInput(const VectorSpace<double> & input)
     // 2. move neuron's belongings, bg/moving, merge, delete, etc.
     rearrangeNeurous();
     //if (m_inputFrames % 100 == 0 && m_idx % 200 == 0)
-    //    LogI("%d : bg size %d, fg size %d.\n", m_idx, 
-    //         (int)m_bgNeurons.size(), (int)m_movingNeurons.size());
+    //    LogI("%d : bg size %d, fg size %d.\n", m_idx, m_bgNum, m_movingNum);
     return bgProbability;
 }
 
-/**** rearrangeNeurous:
- 1. update the winner neuron
- 2. recalculate the neuron group 
- 3. remove death neurons
- 4. return value: >= 0 update ok
-                  < 0 proccess err
+/**** catchUp:
+ 1. replay the skipped frames with this input, up to two memory windows of them
+ 2. older whole windows only age the neurons, their scores are already steady
 ****/
-int ArtNN :: rearrangeNeurous()
+int ArtNN :: catchUp(const ArtVector & input, const unsigned int frames)
 {
-    // moving to bg is important
-    //if (m_bBGWin == false && m_movingNeurons[m_winnerIdx]->getCurScore() >= 4)
-    //{
-    //    Neuron *pNeuron = m_movingNeurons[m_winnerIdx];
-    //    m_bgNeurons.push_back(pNeuron);
-    //    m_movingNeurons.erase(std::remove(m_movingNeurons.begin(), 
-    //                          m_movingNeurons.end(), pNeuron), m_movingNeurons.end());
-    //}
+    settleLosers(m_inputFrames);
+    m_nextDeathCheck = 0;
+    const unsigned int agedFrames = frames >= 2 * MAX_MEMORY_AGES ?
+                                    (frames / MAX_MEMORY_AGES - 1) * MAX_MEMORY_AGES : 0;
+    for (int k = 0; k < m_bgNum; k++)
+        bgNeuron(k).setAges(bgNeuron(k).getAges() + agedFrames);
+    for (int k = 0; k < m_movingNum; k++)
+        movingNeuron(k).setAges(movingNeuron(k).getAges() + agedFrames);
+    m_inputFrames += agedFrames;
+    for (unsigned int n = agedFrames; n < frames; n++)
+        processOneInput(input);
+    return 0;
+}
 
-    // 1. moving dead neurons first
-    for (auto it = m_bgNeurons.begin(); it != m_bgNeurons.end(); /* No Increment */)
+/**** removeDeadNeurons:
+ 1. neurons that have not won for long die, bg ones after 5 memory windows
+ 2. nothing is checked before m_nextDeathCheck: dying takes the age & a score window
+    without wins, and a win only puts that off, so the nearest death of the survivors
+    bounds the next one (fired neurons & catchUp lower it).
+****/
+void ArtNN :: removeDeadNeurons(const unsigned int round)
+{
+    if (round < m_nextDeathCheck)
+        return;
+    unsigned int roundsToDeath = std::numeric_limits<unsigned int>::max();
+    for (int k = 0; k < m_bgNum; /* No Increment */)
     {
-        if (((*it)->getAges() > ((*it)->getMaxMemoryAges()) * 5) && 
-            ((*it)->getCurScore() == 0))
+        if ((bgNeuron(k).getAges() > (bgNeuron(k).getMaxMemoryAges()) * 5) && 
+            (bgNeuron(k).getCurScore() == 0))
         {
             //LogI("bg %d removing dead\n", m_idx);
-            delete *it;
-            m_bgNeurons.erase(it);
+            dropNeuron(m_bgSlots, m_bgNum, k);
         }
         else
-            it++;
+        {
+            roundsToDeath = std::min(roundsToDeath,
+                                     bgNeuron(k).getRoundsToDeath(MAX_MEMORY_AGES * 5));
+            k++;
+        }
     }
 
-    for (auto it = m_movingNeurons.begin(); it != m_movingNeurons.end(); /* No Increment */)
+    for (int k = 0; k < m_movingNum; /* No Increment */)
     {
-        if (((*it)->getAges() > ((*it)->getMaxMemoryAges())) && 
-            ((*it)->getCurScore() == 0))
+        if ((movingNeuron(k).getAges() > (movingNeuron(k).getMaxMemoryAges())) && 
+            (movingNeuron(k).getCurScore() == 0))
         {
             //LogI("moving %d removing dead\n", m_idx);
-            delete *it;
-            m_movingNeurons.erase(it);
+            dropNeuron(m_movingSlots, m_movingNum, k);
         }
         else
-            it++;
+        {
+            roundsToDeath = std::min(roundsToDeath,
+                                     movingNeuron(k).getRoundsToDeath(MAX_MEMORY_AGES));
+            k++;
+        }
     }
+    m_nextDeathCheck = round + std::min(roundsToDeath,
+                                        std::numeric_limits<unsigned int>::max() - round);
+    return;
+}
+
+/**** rearrangeNeurous:
+ 1. update the winner neuron
+ 2. recalculate the neuron group 
+ 3. remove death neurons, their slots are free for new ones
+ 4. return value: >= 0 update ok
+                  < 0 proccess err
+****/
+int ArtNN :: rearrangeNeurous()
+{
+    // moving to bg is important
+    //if (m_bBGWin == false && movingNeuron(m_winnerIdx).getCurScore() >= 4)
+    //{
+    //    m_bgSlots[m_bgNum++] = m_movingSlots[m_winnerIdx];
+    //    removeNeuron(m_movingSlots, m_movingNum, m_winnerIdx);
+    //}
+
+    // 1. moving dead neurons first
+    removeDeadNeurons(m_inputFrames);
 
     // 2. do regrouping TODO: seems here is the most important
     //const int lastNFrames = m_inputFrames < MAX_MEMORY_AGES ? m_inputFrames : MAX_MEMORY_AGES;
@@ -107,216 +285,251 @@ int ArtNN :: rearrangeNeurous()
     
     // 2) move movingGroup's to bgGroup in case of:
     //    a. movingGroup size >> bgGroup b. movingGourp bgPercent is hight.
-    //std::sort(m_movingNeurons.begin(), m_movingNeurons.end(), neuronScoreComp);
-    //unsigned int totalScores = 0;
-    //for (int k = 0; k < (int)m_movingNeurons.size(); k++) // NOTE: from index 1
-    //    totalScores += m_movingNeurons[k]->getCurScore();
-    ////TODO: how to effective move to bg?
-    //if (totalScores * 1.0 / lastNFrames > (m_bgPercent / 2))
-    //{
-    //    auto pNeuron = m_movingNeurons.back();
-    //    m_movingNeurons.pop_back();
-    //    m_bgNeurons.push_back(pNeuron);
-    //}
-    // 
-    //vector<Neuron *> scores;
-    //for (int k = 0; k < (int)m_movingNeurons.size(); k++) // NOTE: from index 1
-    //    if (m_movingNeurons[k]->getCurScore() > 4)
-    //        scores.push_back(m_movingNeurons[k]);
-    //for (int k = 0; k < (int)scores.size(); k++)
-    //{
-    //    m_movingNeurons.erase(std::remove(m_movingNeurons.begin(), 
-    //                    m_movingNeurons.end(), scores[k]), m_movingNeurons.end());
-    //    m_bgNeurons.push_back(scores[k]);
-    //}
+    //TODO: how to effective move to bg? (see the history for the vector based tries)
    
-    // 3. do merging
-    mergeCloseNeurons(m_bgNeurons, "bg");
-    mergeCloseNeurons(m_movingNeurons, "moving");
+    // 3. do merging, once a merge period: neurons only drift together slowly
+    if (m_mergePeriod > 0 && m_inputFrames >= m_nextMerge)
+    {
+        m_nextMerge = m_inputFrames + m_mergePeriod;
+        const int merges = mergeCloseNeurons(m_bgSlots, m_bgNum) +
+                           mergeCloseNeurons(m_movingSlots, m_movingNum);
+        if (merges > 0)
+        {   // a merged neuron has the older age
+            m_merges += merges;
+            m_nextDeathCheck = 0;
+        }
+    }
     return 0;
 }
 
 bool ArtNN :: tryRemoveBgNeurons(const int lastNFrames)
 {
-    std::sort(m_bgNeurons.begin(), m_bgNeurons.end(), neuronScoreComp);
-    unsigned int totalScoresWithoutMin = 0;    
-    for (int k = 1; k < (int)m_bgNeurons.size(); k++) // NOTE: from index 1
-        totalScoresWithoutMin += m_bgNeurons[k]->getCurScore();
+    if (m_bgNum == 0)
+        return false;
+    // the lowest scoring bg neuron, the oldest on ties
+    int minIdx = 0;
+    unsigned int totalScores = 0;    
+    for (int k = 0; k < m_bgNum; k++)
+    {
+        totalScores += bgNeuron(k).getCurScore();
+        if (bgNeuron(k).getCurScore() < bgNeuron(minIdx).getCurScore())
+            minIdx = k;
+    }
+    const unsigned int totalScoresWithoutMin = totalScores - bgNeuron(minIdx).getCurScore();
 
     if (totalScoresWithoutMin * 1.0 / lastNFrames > m_bgPercent && 
-        m_bgNeurons[0]->getAges() >= MAX_MEMORY_AGES &&
-        m_bgNeurons[0]->getCurScore() < 2)
+        bgNeuron(minIdx).getAges() >= MAX_MEMORY_AGES &&
+        bgNeuron(minIdx).getCurScore() < 2)
     {   // ok, we can move this neuron to foreground group
-        auto it = m_bgNeurons.begin();
         //LogI("%d total score without min: %d, kick's score: %d.\n", 
-        //     m_idx, totalScoresWithoutMin, m_bgNeurons[0]->getCurScore());
-        //m_movingNeurons.push_back(*it);
-        delete *it;
-        m_bgNeurons.erase(it);
+        //     m_idx, totalScoresWithoutMin, bgNeuron(minIdx).getCurScore());
+        dropNeuron(m_bgSlots, m_bgNum, minIdx);
         return true;
     }
 
     return false;
 }
 
-// each time we at most merge one pair
-void ArtNN :: mergeCloseNeurons(vector<Neuron *> & neurons, const string & mergeType)
+/**** mergeCloseNeurons:
+ 1. two neurons of a group overlap if their distance is under m_overlapRate of their
+    vigilances together; the older one takes the younger in, in place (Neuron::mergeWith)
+ 2. the younger one's slot goes back to the net & the budget
+ 3. return value: the merges
+****/
+int ArtNN :: mergeCloseNeurons(unsigned char * slots, unsigned char & num)
 {
-    // TODO: debug
-    return;
-
-    bool canMerge = false;
-    auto it1 = neurons.begin();
-    auto it2 = neurons.begin();
-    for (/**/; it1 != neurons.end(); it1++)
+    int merges = 0;
+    for (int idx1 = 0; idx1 < num; idx1++)
     {
-        for (/**/; it2 != neurons.end(); it2++)
+        for (int idx2 = idx1 + 1; idx2 < num; /* No Increment */)
         {
-            if (it1 != it2)
+            Neuron & n1 = m_pSlots[slots[idx1]];
+            Neuron & n2 = m_pSlots[slots[idx2]];
+            if (ArtVector::rgbEulerDistance(n1.getWeights(), n2.getWeights()) >=
+                (n1.getCurVigilance() + n2.getCurVigilance()) * m_overlapRate)
             {
-                canMerge = VectorSpace<double>::rgbEulerDistance((*it1)->getWeightVector(), (*it2)->getWeightVector()) /
-                                                ((*it1)->getCurVigilance() + (*it2)->getCurVigilance()) < m_overlapRate;
-                if (canMerge == true)
-                    break;
+                idx2++;
+                continue;
             }
+            n1.mergeWith(n2);
+            dropNeuron(slots, num, idx2);
+            merges++;
         }
-        if (it2 != neurons.end())
-            break;
-    }
-    
-    if (canMerge == true)
-    {
-        const int a1 = (*it1)->getCurScore();
-        const int a2 = (*it2)->getCurScore();
-        const double v1 = (*it1)->getCurVigilance();
-        const double v2 = (*it2)->getCurVigilance();
-        VectorSpace<double> newWeight = ((*it1)->getWeightVector() * a1 + 
-                                         (*it2)->getWeightVector() * a2) * (1.0 / (a1 + a2));
-        
-        const double vigilanceDiff = std::min(VectorSpace<double>::rgbEulerDistance((*it1)->getWeightVector(), newWeight),
-                                              VectorSpace<double>::rgbEulerDistance((*it2)->getWeightVector(), newWeight));
-        const double newVigilance = (a1 * v1 + a2 * v2) / (a1 + a2) + vigilanceDiff;
-        newWeight.dumpComponents();
-
-        Neuron * pMergeNeuron = new Neuron(newWeight); // using it2 as the default
-        pMergeNeuron->setScores((*it2)->getScores());
-        pMergeNeuron->setCurScore((*it2)->getCurScore());
-        pMergeNeuron->setAges((*it2)->getAges());
-        pMergeNeuron->setVigilance(newVigilance);
-
-        // learning rate no need to copy
-        Neuron *p1 = *it1;
-        Neuron *p2 = *it2;
-        p1->getWeightVector().dumpComponents();
-        p2->getWeightVector().dumpComponents();
-        LogI ("%s MergeNeuron: a1 %d, a2 %d, v1 %.2f, v2 %.2f, diff %.2f, p1 %p, p2 %p.\n", 
-              mergeType.c_str(), a1, a2, v1, v2, vigilanceDiff, p1, p2);
-        delete p1;
-        delete p2;
-        neurons.erase(std::remove(neurons.begin(), neurons.end(), p1), neurons.end());
-        neurons.erase(std::remove(neurons.begin(), neurons.end(), p2), neurons.end());
-        neurons.push_back(pMergeNeuron);
     }
+    return merges;
+}
 
+void ArtNN :: setMergePeriod(const unsigned int period)
+{
+    m_mergePeriod = period;
+    m_nextMerge = period > 0 ? m_inputFrames + 1 + m_idx % period : 0;
     return;
 }
 
 /**** fireANewNeuron:
- 1. initial a new neuron withe the input Vector as the weightVector
+ 1. initial a new neuron withe the input Vector as the weightVector, in a free slot
  2. put it in the proper group: bg or moving 
  3. return value: >= 0 the probability of neuron being a bg neuron
                   < 0 proccess err
 ****/
-double ArtNN :: fireANewNeuron(const VectorSpace<double> & input)
+double ArtNN :: fireANewNeuron(const ArtVector & input)
 {   // for the new neuron, it is a = 1, T = 1, keep that.
     // there are several condition, when we create a new neuron.
     // 1. the first several frames, with BG / Moving Group are not stable.
     // 2. the stream has taken for some time, we have a relative stable BG.    
     // TODO: 
-    Neuron *pNew = new Neuron(input);
-    if (m_bgNeurons.size() == 0)   
+    const int slot = takeFreeSlot();
+    m_pSlots[slot].reset(input);
+    m_nextDeathCheck = std::min(m_nextDeathCheck, m_inputFrames + MAX_MEMORY_AGES + 1);
+    if (m_bgNum == 0)   
     {
-        m_bgNeurons.push_back(pNew);
+        m_bgSlots[m_bgNum++] = slot;
         m_bBGWin = true;
-        m_winnerIdx = m_bgNeurons.size() - 1;
+        m_winnerIdx = m_bgNum - 1;
+        m_winnerClearance = 0.0;
         return 1.0;
     }
-    //else if (m_bgNeurons.size() > 8 && 
-    //         m_bgNeurons.size() >= m_movingNeurons.size())
+    //else if (m_bgNum > 8 && m_bgNum >= m_movingNum)
     //{
-    //    m_movingNeurons.push_back(pNew);
+    //    m_movingSlots[m_movingNum++] = slot;
     //    m_bBGWin = false;
-    //    m_winnerIdx = m_movingNeurons.size() - 1;
+    //    m_winnerIdx = m_movingNum - 1;
     //    return 0.0;
     //}
-    // 
-    //// we check the last win
-    //if (m_bBGWin == true)
-    //{
-    //    m_bgNeurons.push_back(pNew);
-    //    m_bBGWin = true;
-    //    m_winnerIdx = m_bgNeurons.size() - 1;
-    //    return 1.0;
-    //}
 
-    m_movingNeurons.push_back(pNew);
+    m_movingSlots[m_movingNum++] = slot;
     m_bBGWin = false;
-    m_winnerIdx = m_movingNeurons.size() - 1;    
+    m_winnerIdx = m_movingNum - 1;    
+    m_winnerClearance = 0.0;
     return 0.0;
 }
 
 /**** calculateNeuronScoreWithNewInput:
- 1. calculate the similarity(euler distance) of the input with the existing neurons
+ 1. calculate the similarity(euler distance) of the input with the existing neurons,
+    or only with the last winner if it is surely the nearest (see tryLastWinner)
  2. set the winner: m_bBGWin & m_winnerIdx
  3. winner neuron do the vigilance test
  4. return value: nearest distance with the existing neurons.
 ****/
-double ArtNN :: updateNeuronsWithNewInput(const VectorSpace<double> & input)
+double ArtNN :: updateNeuronsWithNewInput(const ArtVector & input)
 {
     double distance = std::numeric_limits<double>::max();
     // 1. if no neurons in the net, we return nagive 
-    if (m_bgNeurons.size() == 0 && m_movingNeurons.size() == 0)
+    if (m_bgNum == 0 && m_movingNum == 0)
         return distance;
-
-    // 2. calculate all neurons' rgbEulerDistance with the input
-    //    set all neurons' as the loser neuron first, then reset the winner neuron.
-    // background neurons
-    for (int k = 0; k < (int)m_bgNeurons.size(); k++)
-    {   
-        m_bgNeurons[k]->updateScoreAsLoser();
-        const double tmp = VectorSpace<double>::rgbEulerDistance(m_bgNeurons[k]->getWeightVector(), input);
-        if (tmp < distance)
-        {
-            distance = tmp;
-            m_bBGWin = true;
-            m_winnerIdx = k;
-        }                                                                                       
+    settleLosers(m_inputFrames - 1); // this round's loss is in the scan
+    if (m_bgNum + m_movingNum > 1)
+        m_fullScans++;
+
+    // 2. calculate all neurons' rgbEulerDistance with the input, in one batch: compare
+    //    the squared integer distances, sqrt is monotone. All neurons lose first, then the
+    //    winner neuron is reset.
+    ArtVector weights[ART_NEURON_SLOTS];
+    int squared[ART_NEURON_SLOTS];
+    for (int k = 0; k < m_bgNum; k++)
+    {
+        bgNeuron(k).updateScoreAsLoser();
+        weights[k] = bgNeuron(k).getWeights();
     }
-    // moving neurons
-    for (int k = 0; k < (int)m_movingNeurons.size(); k++)
+    for (int k = 0; k < m_movingNum; k++)
     {
-        m_movingNeurons[k]->updateScoreAsLoser();
-        const double tmp = VectorSpace<double>::rgbEulerDistance(m_movingNeurons[k]->getWeightVector(), input);
-        if (tmp < distance)
+        movingNeuron(k).updateScoreAsLoser();
+        weights[m_bgNum + k] = movingNeuron(k).getWeights();
+    }
+    ArtVector::rgbSquaredDistances(input, weights, m_bgNum + m_movingNum, squared);
+    int nearest = std::numeric_limits<int>::max();
+    int second = nearest;
+    int nearestK = 0;
+    for (int k = 0; k < m_bgNum + m_movingNum; k++)
+    {
+        if (squared[k] < nearest)
         {
-            distance = tmp;
-            m_bBGWin = false;
-            m_winnerIdx = k;
-        }                                                       
+            second = nearest;
+            nearest = squared[k];
+            nearestK = k;
+        }
+        else if (squared[k] < second)
+            second = squared[k];
     }
+    m_bBGWin = nearestK < m_bgNum;
+    m_winnerIdx = m_bBGWin ? nearestK : nearestK - m_bgNum;
+    distance = sqrt(nearest);
+    const double secondDistance = second == std::numeric_limits<int>::max() ?
+                                  std::numeric_limits<double>::max() : sqrt(second);
 
     // update the winning neuron's weight vector
-    const bool bVigilanceTestPass = m_bBGWin ?
-                   m_bgNeurons[m_winnerIdx]->doVigilanceTest(distance) :
-                   m_movingNeurons[m_winnerIdx]->doVigilanceTest(distance);
-    if (bVigilanceTestPass == true)
-    {
-        if (m_bBGWin == true)
-            m_bgNeurons[m_winnerIdx]->reupdateThisRoundAsWinner(input);
-        else
-            m_movingNeurons[m_winnerIdx]->reupdateThisRoundAsWinner(input);
+    Neuron & winner = m_bBGWin ? bgNeuron(m_winnerIdx) : movingNeuron(m_winnerIdx);
+    m_winnerClearance = 0.0;
+    if (winner.doVigilanceTest(distance) == true)
+    {   // L of the winner to the others, by the triangle inequality: >= L(input, other)
+        // - L(input, winner), less the winner's move
+        m_winnerClearance = secondDistance / ART_FAST_PATH_SCALE - distance -
+                            ART_FAST_PATH_ERROR;
+        m_winnerSlot = m_bBGWin ? m_bgSlots[m_winnerIdx] : m_movingSlots[m_winnerIdx];
+        winner.reupdateThisRoundAsWinner(input);
+        m_winnerClearance -= (distance + ART_FAST_PATH_ERROR) * winner.getLearningRate();
     }
+    return remapMovingDistance(distance);
+}
 
+/**** tryLastWinner:
+ 1. the last winner is surely the nearest neuron if the input is closer to it than about
+    half of its clearance, a lower bound of L(winner - other) over the other neurons.
+ 2. the bound is exact: rgbEulerDistance's red & blue factors are (512 + meanRed) / 256
+    & (767 - meanRed) / 256, in [2, 3) for meanRed in [0, 255], green's is 4; so with t the
+    difference v truncated (|t| <= |v| & |v - t| < 1 by component):
+    L(t) <= d <= sqrt(1.5) * L(t) <= SCALE * L(v), and d >= L(t) > L(v) - sqrt(8) = L(v) -
+    ERROR. L is a norm, so for an other neuron o, with D the input's d to the winner w:
+    d(x, o) > L(x - o) - ERROR >= L(w - o) - L(x - w) - ERROR > clearance - D - 2 * ERROR,
+    which is >= D when 2 * (D + ERROR) <= clearance: o can't win, nor tie.
+ 3. the clearance is set by the full scan (see updateNeuronsWithNewInput), and shrinks by
+    L of each move of the winner, learning rate * L(x - w) < rate * (D + ERROR).
+ 4. the winner loses & wins again like in the full scan, the others' losses are only
+    counted, settleLosers applies them in bulk before anything looks at them.
+ 5. no round from m_nextDeathCheck on is fast: a neuron that may die then dies on the
+    same round as in the full scan, and frees its place in the tile's NeuronBudget for
+    the neighbours before they fire.
+ 6. so the winner, the distance & all state are the full scan's: the mask is the same.
+ 7. return value: true if the input is done, its (remapped) distance in 'distance'
+****/
+bool ArtNN :: tryLastWinner(const ArtVector & input, double & distance)
+{
+    if (m_winnerClearance <= 2.0 * ART_FAST_PATH_ERROR || // also after the neurons changed
+        m_inputFrames >= m_nextDeathCheck)
+        return false;
+    Neuron & winner = m_pSlots[m_winnerSlot];
+    distance = ArtVector::rgbEulerDistance(winner.getWeights(), input);
+    if (2.0 * (distance + ART_FAST_PATH_ERROR) >= m_winnerClearance ||
+        winner.doVigilanceTest(distance) == false)
+        return false;
+    m_pendingLosses++;
+    winner.updateScoreAsLoser();
+    winner.reupdateThisRoundAsWinner(input);
+    m_winnerClearance -= (distance + ART_FAST_PATH_ERROR) * winner.getLearningRate();
+    distance = remapMovingDistance(distance);
+    return true;
+}
+
+// the fast path rounds' losses of the neurons but the winner, and the deaths in them;
+// the same state as losing round by round with rearrangeNeurous after each, up to 'round'.
+void ArtNN :: settleLosers(const unsigned int round)
+{
+    if (m_pendingLosses == 0)
+        return;
+    for (int k = 0; k < m_bgNum; k++)
+        if (m_bBGWin == false || k != m_winnerIdx)
+            bgNeuron(k).updateScoreAsLoser(m_pendingLosses);
+    for (int k = 0; k < m_movingNum; k++)
+        if (m_bBGWin == true || k != m_winnerIdx)
+            movingNeuron(k).updateScoreAsLoser(m_pendingLosses);
+    m_pendingLosses = 0;
+    removeDeadNeurons(round);
+    return;
+}
+
+// a moving winner's distance is pushed to the low bg probabilities
+double ArtNN :: remapMovingDistance(double distance)
+{
     if (m_bBGWin == false)
     {
         //distance = distanceRemap();
@@ -334,41 +547,81 @@ double ArtNN :: updateNeuronsWithNewInput(const VectorSpace<double> & input)
 //// ArtSegment class method
 
 int ArtSegment :: processFrame(const cv::Mat & in, cv::Mat & out)
+{
+    if (m_scaler.isEnabled() == false)
+        return processModelFrame(in, out);
+    const int ret = processModelFrame(m_scaler.downsample(in), m_scaler.getModelMask());
+    m_scaler.upsample(in, out);
+    return ret;
+}
+
+int ArtSegment :: processModelFrame(const cv::Mat & in, cv::Mat & out)
 {
     assert(in.cols == m_imgWidth && in.rows == m_imgHeight);
     assert(out.cols == m_imgWidth && out.rows == m_imgHeight);
     assert(in.channels() == 3 && out.channels() ==1);
-    vector<double> selfProbabilty(m_imgWidth * m_imgHeight, 0.0);
+    m_inputFrames++;
+    if (m_tileGate.isEnabled())
+        m_tileGate.update(in);
+
+    m_pFrameIn = &in;
+    m_pFrameOut = &out;
+    // pixels are independent, but their cost is not (moving areas have more neurons &
+    // gated tiles none), so the small tiles are stolen by whichever thread is idle.
+    m_threadPool.parallelForStealing(m_tileCols * m_tileRows,
+                                     boost::bind(&ArtSegment::classifyTile, this, _1));
+    // the neighbourhood needs the tiles around, all classified after the barrier above.
+    m_threadPool.parallelFor(m_threadNum, boost::bind(&ArtSegment::refineBand, this, _1));
+    if (m_tileGate.isEnabled())
+        m_tileGate.applyMask(out);
+    return 0;
+}
 
-    for (int k = 0; k < m_imgHeight; k++)
+void ArtSegment :: classifyTile(const int tile)
+{
+    const cv::Mat & in = *m_pFrameIn;
+    cv::Mat & out = *m_pFrameOut;
+    const int gateTileSize = m_tileGate.getTileSize();
+    const int rowBegin = tile / m_tileCols * ART_TILE_SIZE;
+    const int rowEnd = std::min(rowBegin + ART_TILE_SIZE, m_imgHeight);
+    const int colBegin = tile % m_tileCols * ART_TILE_SIZE;
+    const int colEnd = std::min(colBegin + ART_TILE_SIZE, m_imgWidth);
+    for (int k = rowBegin; k < rowEnd; k++)
     {
-        unsigned char *data = in.data + k*m_imgWidth * in.channels();
-        for (int j = 0; j < m_imgWidth; j++)
+        const unsigned char * data = in.ptr<unsigned char>(k);
+        uchar * outRow = out.ptr<uchar>(k);
+        for (int j = colBegin; j < colEnd; j++)
         {
-            vector<double> input1;
-            vector<int> input2;
-            const cv::Vec3b & intensity = in.at<cv::Vec3b>(k, j);
-            for(int n=0; n < in.channels(); n++)
-                input1.push_back(intensity[n]);
-            input2.push_back(*(data + j * in.channels()));
-            input2.push_back(*(data + j * in.channels() + 1));
-            input2.push_back(*(data + j * in.channels() + 2));
-            selfProbabilty[k*m_imgWidth+j] =
-                m_pArts[k][j]->processOneInput(VectorSpace<double>(input1));
-            out.at<uchar>(k, j) = 0;
+            if (gateTileSize > 0 && m_tileGate.isRowActive(k, j / gateTileSize) == false)
+                continue;
+            const unsigned char * pixel = data + j * ART_WEIGHT_DIM;
+            const ArtVector input((double)pixel[0], (double)pixel[1], (double)pixel[2]);
+            if (gateTileSize > 0 && m_tileGate.getPendingFrames(k, j / gateTileSize) > 0)
+                m_pArts[k][j]->catchUp(input, m_tileGate.getPendingFrames(k, j / gateTileSize));
+            m_selfProbability[k*m_imgWidth+j] = m_pArts[k][j]->processOneInput(input);
+            outRow[j] = 0;
         }
     }
+    return;
+}
 
-    refineProbabilitiesByCollectiveWisdom(selfProbabilty, out);
-    return 0;
+void ArtSegment :: refineBand(const int band)
+{
+    refineProbabilitiesByCollectiveWisdom(m_selfProbability, *m_pFrameOut,
+                                          m_imgHeight * band / m_threadNum,
+                                          m_imgHeight * (band + 1) / m_threadNum);
+    return;
 }
 
-// recalc every 
-int ArtSegment :: refineProbabilitiesByCollectiveWisdom(vector<double> & p, cv::Mat & out)
+// recalc rows [rowBegin, rowEnd)
+int ArtSegment :: refineProbabilitiesByCollectiveWisdom(const vector<double> & p,
+                                                         cv::Mat & out,
+                                                         const int rowBegin,
+                                                         const int rowEnd)
 {
     // for the borders, we won't draw line, namely take them as background for
     // computation effective.
-    for (int k = 1; k < m_imgHeight - 1; k++)
+    for (int k = std::max(rowBegin, 1); k < std::min(rowEnd, m_imgHeight - 1); k++)
     {
         for (int j = 1; j < m_imgWidth - 1; j++)
         {
@@ -388,29 +641,256 @@ int ArtSegment :: refineProbabilitiesByCollectiveWisdom(vector<double> & p, cv::
     return 0;
 }
 
-ArtSegment :: ArtSegment(const int width, const int height)
-    : m_imgWidth(width)
-    , m_imgHeight(height)
+int ArtSegment :: saveSnapshot(const string & path)
 {
+    Seg_Three::SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.modelKind = Seg_Three::SNAPSHOT_ART_SEGMENT;
+    header.version = ART_SNAPSHOT_VERSION;
+    header.width = m_imgWidth;
+    header.height = m_imgHeight;
+    header.channels = 3;
+    header.inputFrames = m_inputFrames;
+
+    Seg_Three::SnapshotWriter writer;
+    if (writer.open(path, header) < 0)
+        return -1;
     for (int k = 0; k < m_imgHeight; k++)
     {
-        vector<ArtNN *> row;
         for (int j = 0; j < m_imgWidth; j++)
         {
-            ArtNN * pArtNN = new ArtNN(k * m_imgWidth + j);
-            row.push_back(pArtNN);
+            if (m_pArts[k][j]->saveState(writer) != 0)
+            {
+                LogE("Write ArtSegment snapshot %s failed.\n", path.c_str());
+                return -1;
+            }
+        }
+    }
+    return writer.commit();
+}
+
+int ArtSegment :: loadSnapshot(const string & path)
+{
+    Seg_Three::SnapshotReader reader;
+    if (reader.open(path, Seg_Three::SNAPSHOT_ART_SEGMENT, ART_SNAPSHOT_VERSION) < 0)
+        return -1;
+    const Seg_Three::SnapshotHeader & header = reader.header();
+    if (header.width != m_imgWidth || header.height != m_imgHeight || header.channels != 3)
+    {
+        LogW("ArtSegment snapshot %s is %dx%dx%d, the segment is %dx%dx3.\n", path.c_str(),
+             header.width, header.height, header.channels, m_imgWidth, m_imgHeight);
+        return -1;
+    }
+    // load into new nets & slab, so a broken file leaves the current ones untouched
+    vector<Neuron> neuronSlab;
+    vector<vector<ArtNN *> > pArts;
+    buildNets(neuronSlab, pArts);
+    bool bOk = true;
+    vector<long> extraNeurons(m_tileBudgets.size(), 0); // a tile's
+    for (int k = 0; k < m_imgHeight && bOk == true; k++)
+    {
+        for (int j = 0; j < m_imgWidth && bOk == true; j++)
+        {
+            bOk = pArts[k][j]->loadState(reader) == 0;
+            extraNeurons[k / ART_TILE_SIZE * m_tileCols + j / ART_TILE_SIZE] +=
+                std::max(pArts[k][j]->getBgNum() + pArts[k][j]->getMovingNum() - 1, 0);
         }
-        m_pArts.push_back(row);
     }
+    if (bOk == false)
+        LogW("ArtSegment snapshot %s is truncated, or has more than %d neurons a pixel.\n",
+             path.c_str(), m_pixelNeuronCap);
+    else
+    {   // swapping keeps the slots where the nets point to
+        m_neuronSlab.swap(neuronSlab);
+        m_pArts.swap(pArts);
+        m_inputFrames = header.inputFrames;
+        for (int t = 0; t < (int)m_tileBudgets.size(); t++)
+            m_tileBudgets[t].setExtraNeurons(extraNeurons[t]);
+        m_tileGate.reset();
+    }
+    freeNets(pArts);
+    return bOk ? 0 : -1;
+}
 
+ArtSegment :: ArtSegment(const int width, const int height, const int modelScale)
+    : m_modelScale(modelScale == 2 || modelScale == 4 ? modelScale : 1)
+    , m_imgWidth((width + m_modelScale - 1) / m_modelScale)
+    , m_imgHeight((height + m_modelScale - 1) / m_modelScale)
+    , m_pixelNeuronCap(ART_NEURON_SLOTS)
+    , m_extraNeuronLimit(std::numeric_limits<long>::max())
+    , m_bWinnerFastPath(true)
+    , m_mergePeriod(ART_MERGE_PERIOD)
+    , m_inputFrames(0)
+    , m_selfProbability(m_imgWidth * m_imgHeight, 0.0)
+    , m_threadNum(1)
+    , m_tileCols((m_imgWidth + ART_TILE_SIZE - 1) / ART_TILE_SIZE)
+    , m_tileRows((m_imgHeight + ART_TILE_SIZE - 1) / ART_TILE_SIZE)
+    , m_pFrameIn(NULL)
+    , m_pFrameOut(NULL)
+{
+    if (m_modelScale != modelScale)
+        LogW("ArtSegment model scale %d is not 1, 2 or 4, using 1.\n", modelScale);
+    m_scaler.init(width, height, 3, m_modelScale);
+    m_tileBudgets.resize(m_tileCols * m_tileRows);
+    buildNets(m_neuronSlab, m_pArts);
     return;    
 }
 
-ArtSegment :: ~ArtSegment()
+// nets of m_pixelNeuronCap slots in a new slab, all empty
+void ArtSegment :: buildNets(vector<Neuron> & neuronSlab, vector<vector<ArtNN *> > & pArts)
+{
+    neuronSlab.assign(m_imgWidth * m_imgHeight * m_pixelNeuronCap, Neuron());
+    pArts.assign(m_imgHeight, vector<ArtNN *>(m_imgWidth, (ArtNN *)NULL));
+    for (int k = 0; k < m_imgHeight; k++)
+    {
+        for (int j = 0; j < m_imgWidth; j++)
+        {
+            const int idx = k * m_imgWidth + j;
+            NeuronBudget & tileBudget =
+                m_tileBudgets[k / ART_TILE_SIZE * m_tileCols + j / ART_TILE_SIZE];
+            pArts[k][j] = new ArtNN(idx, &neuronSlab[idx * m_pixelNeuronCap],
+                                    m_pixelNeuronCap, &tileBudget);
+            pArts[k][j]->setFastPath(m_bWinnerFastPath);
+            pArts[k][j]->setMergePeriod(m_mergePeriod);
+        }
+    }
+    return;
+}
+
+void ArtSegment :: freeNets(vector<vector<ArtNN *> > & pArts)
+{
+    for (int k = 0; k < (int)pArts.size(); k++)
+        for (int j = 0; j < (int)pArts[k].size(); j++)
+            delete pArts[k][j];
+    pArts.clear();
+    return;
+}
+
+long ArtSegment :: getEvictions() const
 {
+    long evictions = 0;
     for (int k = 0; k < m_imgHeight; k++)
         for (int j = 0; j < m_imgWidth; j++)
-            delete m_pArts[k][j];
+            evictions += m_pArts[k][j]->getEvictions();
+    return evictions;
+}
+
+int ArtSegment :: setNeuronBudget(const int pixelNeuronCap, const long neuronBudget)
+{
+    const long pixelNum = (long)m_imgWidth * m_imgHeight;
+    if (pixelNeuronCap < 1 || pixelNeuronCap > ART_NEURON_SLOTS ||
+        neuronBudget < 0 || (neuronBudget > 0 && neuronBudget < pixelNum))
+    {
+        LogW("ArtSegment neuron budget: %d a pixel (1 - %d), %ld in all (0, or >= %ld).\n",
+             pixelNeuronCap, ART_NEURON_SLOTS, neuronBudget, pixelNum);
+        return -1;
+    }
+    if (pixelNeuronCap != m_pixelNeuronCap)
+    {
+        freeNets(m_pArts);
+        m_pixelNeuronCap = pixelNeuronCap;
+        buildNets(m_neuronSlab, m_pArts);
+        for (int t = 0; t < (int)m_tileBudgets.size(); t++)
+            m_tileBudgets[t].setExtraNeurons(0);
+        m_tileGate.reset();
+    }
+    // nets over the budget (after lowering it) only shrink as their neurons die
+    m_extraNeuronLimit = neuronBudget > 0 ? neuronBudget - pixelNum :
+                         std::numeric_limits<long>::max();
+    splitNeuronBudget();
+    return 0;
+}
+
+// each tile's share of the extra neurons is by its pixels, the rounding's rest goes one
+// a tile to the first tiles: fixed, so the threads never race for the last neurons.
+void ArtSegment :: splitNeuronBudget()
+{
+    const long pixelNum = (long)m_imgWidth * m_imgHeight;
+    if (m_extraNeuronLimit == std::numeric_limits<long>::max())
+    {
+        for (int t = 0; t < (int)m_tileBudgets.size(); t++)
+            m_tileBudgets[t].setExtraLimit(m_extraNeuronLimit);
+        return;
+    }
+    long rest = m_extraNeuronLimit;
+    for (int t = 0; t < (int)m_tileBudgets.size(); t++)
+    {
+        const int tileWidth = std::min((int)ART_TILE_SIZE,
+                                       m_imgWidth - t % m_tileCols * ART_TILE_SIZE);
+        const int tileHeight = std::min((int)ART_TILE_SIZE,
+                                        m_imgHeight - t / m_tileCols * ART_TILE_SIZE);
+        const long share = m_extraNeuronLimit * tileWidth * tileHeight / pixelNum;
+        m_tileBudgets[t].setExtraLimit(share);
+        rest -= share;
+    }
+    for (int t = 0; t < (int)m_tileBudgets.size() && rest > 0; t++, rest--)
+        m_tileBudgets[t].setExtraLimit(m_tileBudgets[t].getExtraLimit() + 1);
+    return;
+}
+
+int ArtSegment :: getNeuronStats(ArtNeuronStats & stats) const
+{
+    memset(&stats, 0, sizeof(stats));
+    for (int k = 0; k < m_imgHeight; k++)
+    {
+        for (int j = 0; j < m_imgWidth; j++)
+        {
+            const ArtNN & net = *m_pArts[k][j];
+            stats.bgNeurons += net.getBgNum();
+            stats.movingNeurons += net.getMovingNum();
+            stats.maxPixelNeurons = std::max(stats.maxPixelNeurons,
+                                             net.getBgNum() + net.getMovingNum());
+            stats.evictions += net.getEvictions();
+            stats.merges += net.getMerges();
+            stats.pixelInputs += net.getInputFrames();
+            stats.fullScans += net.getFullScans();
+        }
+    }
+    stats.pixelNeuronCap = m_pixelNeuronCap;
+    const long pixelNum = (long)m_imgWidth * m_imgHeight;
+    stats.neuronBudget = pixelNum + std::min(m_extraNeuronLimit,
+                                             pixelNum * (m_pixelNeuronCap - 1));
+    stats.neuronBytes = (stats.bgNeurons + stats.movingNeurons) * sizeof(Neuron);
+    stats.modelBytes = getModelBytes();
+    return 0;
+}
+
+void ArtSegment :: setWinnerFastPath(const bool bFastPath)
+{
+    m_bWinnerFastPath = bFastPath;
+    for (int k = 0; k < m_imgHeight; k++)
+        for (int j = 0; j < m_imgWidth; j++)
+            m_pArts[k][j]->setFastPath(bFastPath);
+    return;
+}
+
+int ArtSegment :: setNeuronMergePeriod(const int frames)
+{
+    if (frames < 0)
+        return -1;
+    m_mergePeriod = frames;
+    for (int k = 0; k < m_imgHeight; k++)
+        for (int j = 0; j < m_imgWidth; j++)
+            m_pArts[k][j]->setMergePeriod(frames);
+    return 0;
+}
+
+int ArtSegment :: setThreadNum(const int threadNum)
+{
+    if (threadNum < 1 || m_threadPool.init(threadNum) < 0)
+        return -1;
+    m_threadNum = threadNum;
+    return 0;
+}
+
+int ArtSegment :: setChangeGating(const int tileSize, const int tolerance)
+{
+    return m_tileGate.init(m_imgWidth, m_imgHeight, 3, tileSize, tolerance);
+}
+
+ArtSegment :: ~ArtSegment()
+{
+    freeNets(m_pArts);
     return;        
 }
 
@@ -8,12 +8,17 @@
 #include <stdio.h>
 #include <string.h>
 #include <string>
+#include <limits>
 // tools - just using Mat
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 // project
-#include "segmisc.h"
-#include "vectorspace.h"
+#include "segUtil.h"
+#include "vectorSpace.h"
+#include "segSnapshot.h"
+#include "tileGate.h"
+#include "modelScale.h"
+#include "threadPool.h"
 
 // namespace
 using :: std :: string;
@@ -24,57 +29,79 @@ namespace Art_Segment
 {
 
 enum {MAX_MEMORY_AGES = (25 * 1)}; // 25fps * 1s
+enum {ART_SNAPSHOT_VERSION = 2}; // 2: bit packed score history
+enum {ART_WEIGHT_DIM = 3};   // rgb
+enum {ART_NEURON_SLOTS = 8}; // neurons one pixel can hold, bg & moving together
+enum {ART_TILE_SIZE = 16};    // pixels a side of the tiles processFrame's threads steal
+enum {ART_MERGE_PERIOD = MAX_MEMORY_AGES}; // input frames between a net's neuron merges
+static_assert(MAX_MEMORY_AGES < 32, "a neuron's score history is one 32 bit word");
+typedef VectorSpace<double, ART_WEIGHT_DIM> ArtVector; // an input pixel or weight vector
 //////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////
+// One neuron slot of ArtSegment's slab: all state inline, no heap, so a slot is reused
+// by reset() instead of new/delete.
 class Neuron
 {
 public:
-    explicit Neuron (const VectorSpace<double> & vs)
-        : m_weightVector(vs)
+    Neuron()
+        : m_weights()
         , m_learningRate(1.0)
         , m_vigilance(20.0)
         , m_liveTimes(0)
         , m_curScore(0)
-        , m_scores(MAX_MEMORY_AGES, 0)
+        , m_scoreBits(0)
     {
-    
     }    
     ~Neuron(){}
 
-    //void copyTo(Neuron & newNeuron)
-    //{
-    //    newNeuron.setWeightVector(m_weightVector);
-    //    newNeuron.setNewVigilance(m_vigilance);
-    //    newNeuron.setNewAges(m_liveTimes);
-    //}
+    // (re)start the slot as a new neuron with the input as the weight vector
+    void reset(const ArtVector & weights)
+    {
+        setWeights(weights);
+        m_learningRate = 1.0;
+        m_vigilance = 20.0;
+        m_liveTimes = 0;
+        m_curScore = 0;
+        m_scoreBits = 0;
+    }
    
     // apis
     bool doVigilanceTest(const double distance) {return distance < m_vigilance;}        
-    void setWeightVector(const VectorSpace<double> & vs) {m_weightVector = vs;}
-    VectorSpace<double> & getWeightVector() {return m_weightVector;}
+    void setWeights(const ArtVector & weights) {m_weights = weights;}
+    const ArtVector & getWeights() const {return m_weights;}
     
+    // the score history is a shift register: bit k is the win of k rounds ago. The score
+    // of the win MAX_MEMORY_AGES - 1 rounds ago leaves the current score this round.
     void updateScoreAsLoser()
     {
-        const int thisRoundScoreIdx = m_liveTimes % MAX_MEMORY_AGES;
-        m_scores[thisRoundScoreIdx] = 0;
-        m_curScore -= m_scores[(thisRoundScoreIdx + 1) % MAX_MEMORY_AGES];
+        m_scoreBits = (m_scoreBits << 1) & SCORE_BITS_MASK;
+        m_curScore -= (m_scoreBits >> (MAX_MEMORY_AGES - 1)) & 1;
         m_liveTimes++;
     }
+    // 'rounds' losses at once
+    void updateScoreAsLoser(const unsigned int rounds)
+    {
+        m_scoreBits = rounds < MAX_MEMORY_AGES ? (m_scoreBits << rounds) & SCORE_BITS_MASK : 0;
+        m_curScore = __builtin_popcount(m_scoreBits & (SCORE_BITS_MASK >> 1));
+        m_liveTimes += rounds;
+    }
     // this method must be called afeter 'updateScoreAsLoser()'
-    void reupdateThisRoundAsWinner(const VectorSpace<double> & input) 
+    void reupdateThisRoundAsWinner(const ArtVector & input) 
     {   // 1. score update
-        const int lastUpdateRoundScoreIdx = (m_liveTimes - 1) % MAX_MEMORY_AGES;
-        m_scores[lastUpdateRoundScoreIdx] = 1;
+        m_scoreBits |= 1;
         m_curScore++;
         // 2. learning rate update
         m_learningRate = 0.1; //TODO: 1.0 / (1.0 + m_curScore);
         // 3. weight vector update
-        m_weightVector = m_weightVector + ((input - m_weightVector) * m_learningRate);
+        m_weights = m_weights + ((input - m_weights) * m_learningRate);
     }
 
     unsigned int getMaxMemoryAges() {return MAX_MEMORY_AGES;}
     // getter setter
-    unsigned int getCurScore() {return m_curScore;}
+    double getLearningRate() {return m_learningRate;}
+    void setLearningRate(const double newLearningRate) {m_learningRate = newLearningRate;}
+
+    unsigned int getCurScore() const {return m_curScore;}
     void setCurScore(const unsigned int newCurScore) {m_curScore = newCurScore;}
 
     unsigned int getAges() {return m_liveTimes;}
@@ -83,11 +110,44 @@ public:
     double getCurVigilance() {return m_vigilance;}
     void setVigilance(const double newVigilance) {m_vigilance = newVigilance;}
 
-    vector<unsigned int> & getScores() {return m_scores;}
-    void setScores(vector<unsigned int> & newScores) {m_scores = newScores;}
+    // losses until the neuron may be dead: older than ageLimit, & no win in the score
+    // window (bits 0 .. MAX_MEMORY_AGES - 2, which m_curScore counts)
+    unsigned int getRoundsToDeath(const unsigned int ageLimit) const
+    {
+        const unsigned int window = m_scoreBits & (SCORE_BITS_MASK >> 1);
+        const unsigned int scoreRounds = window == 0 ? 0 :
+                                         MAX_MEMORY_AGES - 1 - (31 - __builtin_clz(window));
+        const unsigned int ageRounds = m_liveTimes <= ageLimit ? ageLimit + 1 - m_liveTimes : 0;
+        return scoreRounds > ageRounds ? scoreRounds : ageRounds;
+    }
+
+    // take an overlapping neuron in: score weighted weight vector & vigilance, widened by
+    // the weight vector's move, the wins of both (one winner a round, so no bit is in
+    // both) & the older age.
+    void mergeWith(const Neuron & other)
+    {
+        const bool bWins = m_curScore + other.m_curScore > 0;
+        const double a1 = bWins ? m_curScore : 1.0; // no wins: the plain mean
+        const double a2 = bWins ? other.m_curScore : 1.0;
+        const ArtVector weights = (m_weights * a1 + other.m_weights * a2) / (a1 + a2);
+        const double move1 = ArtVector::rgbEulerDistance(m_weights, weights);
+        const double move2 = ArtVector::rgbEulerDistance(other.m_weights, weights);
+        m_vigilance = (m_vigilance * a1 + other.m_vigilance * a2) / (a1 + a2) +
+                      (move1 < move2 ? move1 : move2);
+        setWeights(weights);
+        m_scoreBits |= other.m_scoreBits;
+        m_curScore = __builtin_popcount(m_scoreBits & (SCORE_BITS_MASK >> 1));
+        m_liveTimes = m_liveTimes > other.m_liveTimes ? m_liveTimes : other.m_liveTimes;
+    }
+
+    unsigned int getScoreBits() const {return m_scoreBits;}
+    void setScoreBits(const unsigned int newScoreBits)
+    {
+        m_scoreBits = newScoreBits & SCORE_BITS_MASK;
+    }
 
 private:
-    VectorSpace<double> m_weightVector;
+    ArtVector    m_weights;
     double       m_learningRate; // decrease through time with initial value 1.0        
     // winner neuron takes the vigilance test, then update its weightVector
     // or create a new neuron.
@@ -95,40 +155,124 @@ private:
     // to memory previous socres
     unsigned int m_liveTimes;
     unsigned int m_curScore;
-    vector<unsigned int> m_scores;
+    unsigned int m_scoreBits; // last MAX_MEMORY_AGES rounds, bit 0 is this round
+    static const unsigned int SCORE_BITS_MASK = (1u << MAX_MEMORY_AGES) - 1;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+// The neurons the nets of one ART_TILE_SIZE tile may hold beyond their first one: a net can
+// always hold one, so a pixel never has nothing to classify with. Each tile has a fixed
+// share of ArtSegment's budget, & a tile is on one thread at a time, so which pixel gets
+// the last neurons doesn't depend on the threads' timing.
+class NeuronBudget
+{
+public:
+    NeuronBudget() : m_extraNeurons(0), m_extraLimit(std::numeric_limits<long>::max()) {}
+
+    void setExtraLimit(const long extraLimit) {m_extraLimit = extraLimit;}
+    long getExtraLimit() const {return m_extraLimit;}
+    void setExtraNeurons(const long extraNeurons) {m_extraNeurons = extraNeurons;}
+    long getExtraNeurons() const {return m_extraNeurons;}
+    // one more extra neuron, false if the budget is used up
+    bool take()
+    {
+        if (m_extraNeurons >= m_extraLimit)
+            return false;
+        m_extraNeurons++;
+        return true;
+    }
+    void release() {m_extraNeurons--;}
+
+private:
+    long m_extraNeurons;
+    long m_extraLimit;
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////
-// class ART Neural Network
+// class ART Neural Network: its neurons live in slotNum (<= ART_NEURON_SLOTS) slots of
+// ArtSegment's slab; the bg & moving groups are slot indices in firing order. When all
+// slots are taken, or the budget has no neuron left, a new neuron evicts the lowest
+// scoring moving neuron, or the lowest scoring bg neuron if there are no moving ones (the
+// oldest on ties).
 class ArtNN
 {
 public:
-    ArtNN(const int idx) : m_idx(idx), m_bgPercent(0.9), m_overlapRate (0.1), m_inputFrames(0)
+    ArtNN(const int idx, Neuron * pSlots, const int slotNum, NeuronBudget * pBudget)
+        : m_pSlots(pSlots), m_winnerClearance(0.0), m_pendingLosses(0), m_winnerSlot(0)
+        , m_bFastPath(true)
+        , m_idx(idx), m_bgPercent(0.9), m_overlapRate (0.1), m_inputFrames(0)
+        , m_nextDeathCheck(0), m_mergePeriod(ART_MERGE_PERIOD)
+        , m_nextMerge(1 + idx % ART_MERGE_PERIOD)
+        , m_slotNum(slotNum), m_pBudget(pBudget)
+        , m_bgNum(0), m_movingNum(0), m_evictions(0), m_merges(0)
+        , m_bBGWin(true), m_winnerIdx(0), m_fullScans(0)
     { 
         return;
     }
+    ~ArtNN() {}
     // calculate artNN's output, update internal neurons' states.
-    double processOneInput(const VectorSpace<double> & input);
+    double processOneInput(const ArtVector & input);
+    // lazy aging of change gating: 'frames' skipped frames of about this input.
+    int catchUp(const ArtVector & input, const unsigned int frames);
+    // neuron lists & winner state, for ArtSegment's snapshot
+    int saveState(Seg_Three::SnapshotWriter & writer);
+    int loadState(Seg_Three::SnapshotReader & reader);
+    unsigned int getEvictions() const {return m_evictions;}
+    // merge overlapping neurons every 'period' input frames, 0 is never
+    void setMergePeriod(const unsigned int period);
+    unsigned int getMerges() const {return m_merges;}
+    // test the last winner first, and skip the full nearest neuron scan when it surely wins
+    void setFastPath(const bool bFastPath) {m_bFastPath = bFastPath;}
+    unsigned int getFullScans() const {return m_fullScans;}
+    unsigned int getInputFrames() const {return m_inputFrames;}
+    int getBgNum() const {return m_bgNum;}
+    int getMovingNum() const {return m_movingNum;}
 
 private:
+    // neuron models for this pixel, & the fast path's state: first, so that the fast path
+    // reads the winner one cache miss after the net.
+    Neuron * m_pSlots;
+    double m_winnerClearance; // lower bound of L(winner - other), see tryLastWinner
+    unsigned int m_pendingLosses; // fast path rounds the others have not lost yet
+    unsigned char m_winnerSlot;
+    bool m_bFastPath;
     const int m_idx;
     // determine the percent of backgroud neuron's avtivate times in all.
     // for movingNeuron transform to bgNeuron.
     double m_bgPercent; // 0.9
     // if two neurons are close enough (overlap), they are merged.
     double m_overlapRate; // 0.9
-    // neuron models for this pixel
-    vector<Neuron *> m_bgNeurons;
-    vector<Neuron *> m_movingNeurons;
     unsigned int m_inputFrames;
+    unsigned int m_nextDeathCheck; // no neuron can die before this input frame
+    unsigned int m_mergePeriod;
+    unsigned int m_nextMerge; // input frame; staggered by m_idx, so not all nets at once
+    int m_slotNum;
+    NeuronBudget * m_pBudget;
+    unsigned char m_bgSlots[ART_NEURON_SLOTS];
+    unsigned char m_movingSlots[ART_NEURON_SLOTS];
+    unsigned char m_bgNum;
+    unsigned char m_movingNum;
+    unsigned int m_evictions;
+    unsigned int m_merges;
 
 private: // internal helper members
     bool m_bBGWin;
     int m_winnerIdx;
-    double fireANewNeuron(const VectorSpace<double> & input);
-    double updateNeuronsWithNewInput(const VectorSpace<double> & input);
-    void mergeCloseNeurons(vector<Neuron *> & neurons, const string & mergeType);
+    unsigned int m_fullScans;
+    Neuron & bgNeuron(const int k) {return m_pSlots[m_bgSlots[k]];}
+    Neuron & movingNeuron(const int k) {return m_pSlots[m_movingSlots[k]];}
+    int takeFreeSlot();
+    void removeNeuron(unsigned char * slots, unsigned char & num, const int k);
+    void dropNeuron(unsigned char * slots, unsigned char & num, const int k);
+    double fireANewNeuron(const ArtVector & input);
+    double updateNeuronsWithNewInput(const ArtVector & input);
+    bool tryLastWinner(const ArtVector & input, double & distance);
+    void settleLosers(const unsigned int round);
+    void removeDeadNeurons(const unsigned int round);
+    double remapMovingDistance(double distance);
+    int mergeCloseNeurons(unsigned char * slots, unsigned char & num);
     int rearrangeNeurous();
     bool tryRemoveBgNeurons(const int lastNFrames);
 };
@@ -136,6 +280,22 @@ private: // internal helper members
 
 //////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////
+// ArtSegment's neurons & their memory, see getNeuronStats()
+struct ArtNeuronStats
+{
+    long bgNeurons;
+    long movingNeurons;
+    int maxPixelNeurons;  // the most neurons any pixel holds
+    int pixelNeuronCap;   // slots a pixel has
+    long neuronBudget;    // neurons all pixels may hold together
+    long evictions;       // since the start
+    long merges;          // since the start
+    long pixelInputs;     // since the start (or the snapshot), of all pixels
+    long fullScans;       // of nets with more than one neuron, where the fast path failed
+    size_t neuronBytes;   // of the neurons held
+    size_t modelBytes;    // slab & nets, fixed by the caps
+};
+
 struct SegmentFeatures
 {
     int m_xCentroid;
@@ -150,7 +310,8 @@ struct SegmentFeatures
 class ArtSegment
 {
 public:
-    ArtSegment(const int width, const int height);
+    // modelScale 2 or 4: model a 1/modelScale area averaged frame, the mask is scaled back.
+    ArtSegment(const int width, const int height, const int modelScale = 1);
     ~ArtSegment();
     
     // API
@@ -158,13 +319,74 @@ public:
     //                                       const unsigned char * pG, 
     //                                       const unsigned char * pB);
     int processFrame(const cv::Mat & in, cv::Mat & out);
+    // all pixels' neurons to/from a snapshot file of the same frame size.
+    int saveSnapshot(const string & path);
+    int loadSnapshot(const string & path);
+    // skip tileSize x tileSize tiles whose mean absolute difference to the input they were
+    // last processed with is <= tolerance, keeping their mask; tileSize 0 turns it off.
+    int setChangeGating(const int tileSize, const int tolerance);
+    // of the last frame
+    double getSkippedTileFraction() const {return m_tileGate.getSkippedFraction();}
+    // the neuron slab is all the per pixel model, fixed at construction
+    size_t getModelBytes() const
+    {
+        return m_neuronSlab.size() * sizeof(Neuron) + m_pArts.size() * m_imgWidth *
+               sizeof(ArtNN);
+    }
+    // neurons evicted from full pixels since the start
+    long getEvictions() const;
+    // cap the neurons a pixel holds (<= ART_NEURON_SLOTS), and all pixels together
+    // (>= one a pixel, 0 is no cap), which ART_TILE_SIZE tiles share by their pixels; a
+    // full pixel (or tile) evicts its lowest scoring neuron for a new one. A different
+    // pixel cap resizes the slab, so it restarts the model.
+    int setNeuronBudget(const int pixelNeuronCap, const long neuronBudget);
+    int getNeuronStats(ArtNeuronStats & stats) const;
+    // on by default; it only skips the full scan when the last winner surely wins it & no
+    // neuron can die, so the mask is the same as the full scan's, with a neuron budget
+    // too, see ArtNN::tryLastWinner.
+    void setWinnerFastPath(const bool bFastPath);
+    // merge each pixel's overlapping neurons every 'frames' of its input frames
+    // (ART_MERGE_PERIOD by default), 0 turns merging off.
+    int setNeuronMergePeriod(const int frames);
+    void setMaskUpsampleMode(const Seg_Three::MASK_UPSAMPLE_MODE mode)
+    {
+        m_scaler.setUpsampleMode(mode);
+    }
+    // classify ART_TILE_SIZE tiles on threadNum threads; the mask is the same as one
+    // thread's, with a neuron budget too (the tiles have fixed shares of it).
+    int setThreadNum(const int threadNum);
 
 private:
-    const int m_imgWidth;
+    const int m_modelScale;
+    Seg_Three::ModelScaler m_scaler;
+    const int m_imgWidth; // of the model
     const int m_imgHeight;
+    int m_pixelNeuronCap;
+    long m_extraNeuronLimit; // the budget beyond one neuron a pixel, split into:
+    vector<NeuronBudget> m_tileBudgets; // in m_tileCols x m_tileRows
+    bool m_bWinnerFastPath;
+    int m_mergePeriod;
+    vector<Neuron> m_neuronSlab; // m_pixelNeuronCap per pixel, in width x height
     vector<vector<ArtNN *> > m_pArts; // in width x height
     vector<SegmentFeatures> m_features;
-    int refineProbabilitiesByCollectiveWisdom(vector<double> & p, cv::Mat & out);
+    int m_inputFrames;
+    vector<double> m_selfProbability; // skipped tiles keep the last one
+    Seg_Three::TileGate m_tileGate;
+    Seg_Three::ThreadPool m_threadPool;
+    int m_threadNum;
+    int m_tileCols; // of ART_TILE_SIZE tiles
+    int m_tileRows;
+    // the frame being processed, for the tasks: binding it would allocate every frame
+    const cv::Mat * m_pFrameIn;
+    cv::Mat * m_pFrameOut;
+    void buildNets(vector<Neuron> & neuronSlab, vector<vector<ArtNN *> > & pArts);
+    void splitNeuronBudget();
+    void freeNets(vector<vector<ArtNN *> > & pArts);
+    int processModelFrame(const cv::Mat & in, cv::Mat & out);
+    void classifyTile(const int tile);
+    void refineBand(const int band);
+    int refineProbabilitiesByCollectiveWisdom(const vector<double> & p, cv::Mat & out,
+                                              const int rowBegin, const int rowEnd);
 };
 
 } // 
@@ -0,0 +1,157 @@
+// sys
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+// tools
+#include <opencv2/core/core.hpp>
+// project
+#include "artsegment.h"
+
+// namespaces
+using namespace cv;
+using namespace Art_Segment;
+
+///////////////////// Code ///////////////////////////////////////////////////////////////
+namespace
+{
+
+#define BENCH_FRAMES (300)
+#define BENCH_DRIFT_FRAMES (600) // the neurons meet after about 430
+
+enum {BENCH_SCENE_BOX = 0, BENCH_SCENE_LIGHTS, BENCH_SCENE_DRIFT, BENCH_SCENE_NUM};
+
+// green of the drift scene's drifting colour in its 'step'-th frame. A neuron only
+// follows inputs within its vigilance (20) at learning rate 0.1, so the colour moves one
+// green level (distance 2) a frame, and slower near black, where the black neuron would
+// win it if its own neuron lagged behind.
+int driftGreen(const int step)
+{
+    if (step < 235)
+        return 255 - step;
+    if (step < 235 + 16 * 4)
+        return 20 - (step - 235) / 4;
+    return std::max(1, 4 - (step - 235 - 16 * 4) / 20);
+}
+
+// the drift scene: a textured near white background, which a black & a green neuron
+// join (more than 500 apart, so each fires its own); the green then drifts to black,
+// until its neuron overlaps the black one, and merging makes them one.
+void makeDriftFrame(Mat & frame, const int width, const int height, const int frameNo)
+{
+    frame.create(height, width, CV_8UC3);
+    int step = 0; // drifting frames before this one
+    for (int n = 3; n < frameNo; n++)
+        step += n % 10 != 0;
+    for (int k = 0; k < height; k++)
+    {
+        unsigned char * row = frame.ptr<unsigned char>(k);
+        for (int j = 0; j < width; j++)
+        {
+            const int a = (j + 2 * k) & 7;
+            unsigned char * pixel = row + j * 3;
+            pixel[0] = pixel[2] = (unsigned char)a;
+            if (frameNo == 0 || (frameNo > 2 && frameNo % 20 == 0))
+                pixel[0] = pixel[1] = pixel[2] = (unsigned char)(255 - a);
+            else if (frameNo == 2 || (frameNo > 2 && frameNo % 20 == 10))
+                pixel[1] = 0;
+            else
+                pixel[1] = (unsigned char)(frameNo == 1 ? 255 : driftGreen(step));
+        }
+    }
+    return;
+}
+
+// synthetic scenes, so the numbers don't depend on the ./data sequences: textured static
+// background with sensor noise and a moving box. With bLights, the lower quarter blinks
+// through the rgb cube's corners, which keeps several neurons in each pixel.
+void makeFrame(Mat & frame, const int width, const int height, const int frameNo,
+               const bool bLights)
+{
+    frame.create(height, width, CV_8UC3);
+    const int boxX = (frameNo * 4) % width;
+    const int boxY = height / 3;
+    for (int k = 0; k < height; k++)
+    {
+        unsigned char * row = frame.ptr<unsigned char>(k);
+        for (int j = 0; j < width; j++)
+        {
+            const bool bBox = j >= boxX && j < boxX + width / 8 &&
+                              k >= boxY && k < boxY + height / 6;
+            const int corner = (frameNo + (k * width + j) % 13) / 10 % 8;
+            const bool bLight = bLights && k >= height * 3 / 4 && corner > 0;
+            for (int c = 0; c < 3; c++)
+            {
+                const int bg = ((j * 3 + k * 5 + c * 40) & 0xFF) + rand() % 7 - 3;
+                const int v = bLight ? ((corner >> c) & 1) * 255 : (bBox ? 230 - c * 70 : bg);
+                row[j * 3 + c] = (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+            }
+        }
+    }
+    return;
+}
+
+double benchOneArtSegment(ArtSegment & asn, const vector<Mat> & frames, const int width,
+                          const int height)
+{
+    Mat binaryFrame(height, width, CV_8UC1);
+    const int64 start = getTickCount();
+    for (int k = 0; k < (int)frames.size(); k++)
+        asn.processFrame(frames[k], binaryFrame);
+    return (getTickCount() - start) * 1000.0 / getTickFrequency() / frames.size();
+}
+
+} // namespace
+
+///////////////////// Bench //////////////////////////////////////////////////////////////
+// usage: artbench.out [width height [threads ...]]; with several thread counts, each
+// line also has its speedup over the first count's.
+int main(int argc, char * argv[])
+{
+    const int width = argc > 2 ? atoi(argv[1]) : 320;
+    const int height = argc > 2 ? atoi(argv[2]) : 240;
+    vector<int> threadNums;
+    for (int n = 3; n < argc; n++)
+        threadNums.push_back(atoi(argv[n]));
+    if (threadNums.empty())
+        threadNums.push_back(1);
+    printf("ArtSegment bench: %dx%d, %d frames (drift %d), %d thread counts.\n", width,
+           height, BENCH_FRAMES, BENCH_DRIFT_FRAMES, (int)threadNums.size());
+    const char * sceneStr[] = {"box", "lights", "drift"};
+    for (int scene = 0; scene < BENCH_SCENE_NUM; scene++)
+    {
+        vector<Mat> frames(scene == BENCH_SCENE_DRIFT ? BENCH_DRIFT_FRAMES : BENCH_FRAMES);
+        for (int k = 0; k < (int)frames.size(); k++)
+        {
+            if (scene == BENCH_SCENE_DRIFT)
+                makeDriftFrame(frames[k], width, height, k);
+            else
+                makeFrame(frames[k], width, height, k, scene == BENCH_SCENE_LIGHTS);
+        }
+        // neuron merging off, then every ART_MERGE_PERIOD input frames
+        for (int mergePeriod = 0; mergePeriod <= ART_MERGE_PERIOD;
+             mergePeriod += ART_MERGE_PERIOD)
+        {
+            double firstMs = 0.0;
+            for (int t = 0; t < (int)threadNums.size(); t++)
+            {
+                ArtSegment asn(width, height);
+                asn.setThreadNum(threadNums[t]);
+                asn.setNeuronMergePeriod(mergePeriod);
+                const double ms = benchOneArtSegment(asn, frames, width, height);
+                if (t == 0)
+                    firstMs = ms;
+                ArtNeuronStats stats;
+                asn.getNeuronStats(stats);
+                printf("%-6s merge %-3s %d threads: %7.2f ms/frame, %6.1f fps (x%.2f), "
+                       "%.3f neurons/pixel (max %d), %ld merges, full scans %4.1f%%.\n",
+                       sceneStr[scene], mergePeriod > 0 ? "on" : "off",
+                       threadNums[t], ms, 1000.0 / ms, firstMs / ms,
+                       (double)(stats.bgNeurons + stats.movingNeurons) /
+                       ((double)width * height), stats.maxPixelNeurons, stats.merges,
+                       stats.pixelInputs > 0 ?
+                       stats.fullScans * 100.0 / stats.pixelInputs : 0.0);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,118 @@
+// sys
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+// tools
+#include <opencv2/core/core.hpp>
+// project
+#include "boundaryScan.h"
+
+// namespaces
+using namespace cv;
+using namespace Seg_Three;
+
+///////////////////// Code ///////////////////////////////////////////////////////////////
+namespace
+{
+
+#define BENCH_FRAMES (300)
+#define BENCH_RING (16) // distinct frames, cycled: 4K frames are 8 MB each
+#define BENCH_SKIP (32)
+#define BENCH_SCAN_SIZE (2)
+
+// synthetic border bands: runs of foreground along each border & the mvs under them.
+// Fragmented, the runs are 3 - 14 pixels with gaps of 1 - 8, so the scan finds many short
+// lines that premergeLines & goMarking join again & again; else a few long runs.
+void makeFrame(BgResult & bgResult, const int width, const int height, const int frameNo,
+               const bool bFragmented)
+{
+    Mat & binary = bgResult.binaryData;
+    binary.create(height, width, CV_8UC1);
+    memset(binary.data, 0, width * height);
+    const int bandTB = BENCH_SKIP + BENCH_SCAN_SIZE + 2;
+    for (int n = 0; n < BORDER_NUM; n++)
+    {
+        const int borderWidth = n < 2 ? width - 2 * BENCH_SKIP : height - 2 * BENCH_SKIP;
+        bool bRun = false;
+        int next = 0;
+        for (int j = 0; j < borderWidth; j++)
+        {
+            if (j == next) // start or end a run, shifting a little each frame
+            {
+                bRun = !bRun;
+                const int len = bFragmented ? (bRun ? 3 + rand() % 12 : 1 + rand() % 8) :
+                                              (bRun ? 60 + rand() % 200 : 20 + rand() % 100);
+                next = j + len + (frameNo % 3);
+            }
+            // the same mvs each frame: objects keep moving the same way, with some noise
+            const int mvIdx = j + borderWidth; // the mvs of the strip's second row
+            const double noise = ((j * 37 + n * 11) % 100 - 50) / 25.0;
+            bgResult.xMvs[n][j] = bgResult.xMvs[n][mvIdx] = ((j / 97) % 2 ? 2.0 : -2.0) + noise;
+            bgResult.yMvs[n][j] = bgResult.yMvs[n][mvIdx] = (n % 2 ? 1.5 : -1.5) + noise / 2;
+            if (!bRun)
+                continue;
+            for (int k = BENCH_SKIP - 2; k < bandTB; k++)
+            {
+                const int x = BENCH_SKIP + j, y = BENCH_SKIP + j;
+                if (n == 0)
+                    binary.at<uchar>(k, x) = 0xFF;
+                else if (n == 1)
+                    binary.at<uchar>(height - 1 - k, x) = 0xFF;
+                else if (n == 2)
+                    binary.at<uchar>(y, k) = 0xFF;
+                else
+                    binary.at<uchar>(y, width - 1 - k) = 0xFF;
+            }
+        }
+    }
+    return;
+}
+
+} // namespace
+
+///////////////////// Bench //////////////////////////////////////////////////////////////
+// usage: boundarybench.out
+int main(int argc, char * argv[])
+{
+    const int sizes[][2] = {{640, 480}, {1920, 1080}, {3840, 2160}};
+    printf("BoundaryScan bench: %d frames, skip %d, scan size %d.\n", BENCH_FRAMES, BENCH_SKIP,
+           BENCH_SCAN_SIZE);
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+    {
+        const int width = sizes[s][0], height = sizes[s][1];
+        for (int scene = 0; scene < 2; scene++)
+        {
+            const bool bFragmented = scene == 1;
+            vector<BgResult> frames(BENCH_RING);
+            srand(1);
+            for (int k = 0; k < BENCH_RING; k++)
+            {
+                for (int n = 0; n < BORDER_NUM; n++)
+                {
+                    const int borderWidth = n < 2 ? width - 2 * BENCH_SKIP :
+                                                    height - 2 * BENCH_SKIP;
+                    frames[k].xMvs[n].resize(borderWidth * BENCH_SCAN_SIZE);
+                    frames[k].yMvs[n].resize(borderWidth * BENCH_SCAN_SIZE);
+                }
+                makeFrame(frames[k], width, height, k, bFragmented);
+            }
+            BoundaryScan scan;
+            scan.init(width, height, BENCH_SKIP, BENCH_SKIP, BENCH_SCAN_SIZE, BENCH_SCAN_SIZE, 1);
+            long lines = 0;
+            int64 ticks = 0;
+            for (int k = 0; k < BENCH_FRAMES; k++)
+            {
+                BgResult & frame = frames[k % BENCH_RING];
+                const int64 start = getTickCount();
+                scan.processFrame(frame);
+                ticks += getTickCount() - start;
+                for (int n = 0; n < BORDER_NUM; n++)
+                    lines += frame.resultLines[n].size();
+            }
+            const double ms = ticks * 1000.0 / getTickFrequency() / BENCH_FRAMES;
+            printf("%4dx%-4d %-10s: %7.3f ms/frame, %6.1f output lines/frame.\n", width, height,
+                   bFragmented ? "fragmented" : "long", ms, (double)lines / BENCH_FRAMES);
+        }
+    }
+    return 0;
+}
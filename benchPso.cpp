@@ -0,0 +1,172 @@
+// sys
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+// tools
+#include <opencv2/core/core.hpp>
+// project
+#include "psoBook.h"
+
+// namespaces
+using std :: string;
+using namespace cv;
+using namespace Seg_Three;
+
+///////////////////// Code ///////////////////////////////////////////////////////////////
+namespace
+{
+
+#define BENCH_FRAMES (200)
+
+// synthetic scene: textured static background with sensor noise and a moving box, so
+// the numbers don't depend on the ./data sequences.
+void makeFrame(Mat & frame, const int width, const int height, const int channels,
+               const int frameNo)
+{
+    frame.create(height, width, channels == 3 ? CV_8UC3 : CV_8UC1);
+    const int boxX = (frameNo * 4) % width;
+    const int boxY = height / 3;
+    for (int k = 0; k < height; k++)
+    {
+        unsigned char * row = frame.ptr<unsigned char>(k);
+        for (int j = 0; j < width; j++)
+        {
+            const bool bBox = j >= boxX && j < boxX + width / 8 &&
+                              k >= boxY && k < boxY + height / 6;
+            for (int c = 0; c < channels; c++)
+            {
+                const int bg = ((j * 3 + k * 5 + c * 40) & 0xFF) + rand() % 7 - 3;
+                const int v = bBox ? 230 - c * 70 : bg;
+                row[j * channels + c] = (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+            }
+        }
+    }
+    return;
+}
+
+double benchOnePsoBook(PsoBook & psoBook, const vector<Mat> & frames, const int width,
+                       const int height, const bool bGray)
+{
+    Mat binaryFrame(height, width, CV_8UC1);
+    const int64 start = getTickCount();
+    for (int k = 0; k < BENCH_FRAMES; k++)
+    {
+        if (bGray)
+            psoBook.processFrameGray(frames[k % frames.size()], binaryFrame);
+        else
+            psoBook.processFrameRgb(frames[k % frames.size()], binaryFrame);
+    }
+    return (getTickCount() - start) * 1000.0 / getTickFrequency() / BENCH_FRAMES;
+}
+
+// masks of a full resolution book for the same frames, to compare the scaled ones with
+void makeReferenceMasks(const vector<Mat> & frames, const int width, const int height,
+                        vector<Mat> & masks)
+{
+    PsoBook psoBook;
+    psoBook.init(width, height);
+    masks.resize(BENCH_FRAMES);
+    for (int k = 0; k < BENCH_FRAMES; k++)
+    {
+        masks[k].create(height, width, CV_8UC1);
+        psoBook.processFrameRgb(frames[k % frames.size()], masks[k]);
+    }
+    return;
+}
+
+// ms/frame, the fraction of mask pixels equal to the full resolution ones, and the
+// foreground's intersection over union with them
+double benchScaledPsoBook(PsoBook & psoBook, const vector<Mat> & frames,
+                          const vector<Mat> & masks, const int width, const int height,
+                          double & agreement, double & fgIou)
+{
+    Mat binaryFrame(height, width, CV_8UC1);
+    long equalPixels = 0, fgBoth = 0, fgAny = 0;
+    double ticks = 0;
+    for (int k = 0; k < BENCH_FRAMES; k++)
+    {
+        const int64 start = getTickCount();
+        psoBook.processFrameRgb(frames[k % frames.size()], binaryFrame);
+        ticks += getTickCount() - start;
+        for (int i = 0; i < height; i++)
+        {
+            const unsigned char * a = binaryFrame.ptr<unsigned char>(i);
+            const unsigned char * b = masks[k].ptr<unsigned char>(i);
+            for (int j = 0; j < width; j++)
+            {
+                equalPixels += a[j] == b[j];
+                fgBoth += a[j] != 0 && b[j] != 0;
+                fgAny += a[j] != 0 || b[j] != 0;
+            }
+        }
+    }
+    agreement = (double)equalPixels / ((double)width * height * BENCH_FRAMES);
+    fgIou = fgAny > 0 ? (double)fgBoth / fgAny : 1.0;
+    return ticks * 1000.0 / getTickFrequency() / BENCH_FRAMES;
+}
+
+} // namespace
+
+///////////////////// Bench //////////////////////////////////////////////////////////////
+// usage: psobench.out [width height]
+int main(int argc, char * argv[])
+{
+    const int width = argc > 2 ? atoi(argv[1]) : 640;
+    const int height = argc > 2 ? atoi(argv[2]) : 480;
+    vector<Mat> rgbFrames(16), grayFrames(16);
+    for (int k = 0; k < (int)rgbFrames.size(); k++)
+    {
+        makeFrame(rgbFrames[k], width, height, 3, k);
+        makeFrame(grayFrames[k], width, height, 1, k);
+    }
+
+    printf("PsoBook bench: %dx%d, %d frames.\n", width, height, BENCH_FRAMES);
+    const PSO_MODEL_TYPE types[2] = {PSO_MODEL_DOUBLE, PSO_MODEL_COMPACT};
+    for (int t = 0; t < 2; t++)
+    {
+        for (int channels = 3; channels >= 1; channels -= 2)
+        {
+            PsoBook psoBook;
+            psoBook.setModelType(types[t]);
+            psoBook.init(width, height, channels);
+            const double ms = benchOnePsoBook(psoBook, channels == 3 ? rgbFrames : grayFrames,
+                                              width, height, channels == 1);
+            printf("%-8s %-4s kernel %-6s: %7.2f ms/frame, %7.1f fps, model %6.1f MB.\n",
+                   types[t] == PSO_MODEL_DOUBLE ? "double" : "compact",
+                   channels == 3 ? "rgb" : "gray", psoBook.getKernelStr(), ms, 1000.0 / ms,
+                   psoBook.getModelBytes() / (1024.0 * 1024.0));
+        }
+    }
+
+    // change gating: the static background tiles are skipped
+    PsoBook gatedBook;
+    gatedBook.init(width, height);
+    gatedBook.setChangeGating(16, 4);
+    const double ms = benchOnePsoBook(gatedBook, rgbFrames, width, height, false);
+    printf("double   rgb  gated 16/4   : %7.2f ms/frame, %7.1f fps, skipped %4.1f%% tiles.\n",
+           ms, 1000.0 / ms, gatedBook.getSkippedTileFraction() * 100.0);
+
+    // reduced resolution: throughput against agreement with the full resolution mask
+    vector<Mat> masks;
+    makeReferenceMasks(rgbFrames, width, height, masks);
+    for (int scale = 2; scale <= 4; scale *= 2)
+    {
+        for (int mode = MASK_UPSAMPLE_NEAREST; mode <= MASK_UPSAMPLE_EDGE; mode++)
+        {
+            PsoBook scaledBook;
+            scaledBook.setModelScale(scale);
+            scaledBook.setMaskUpsampleMode((MASK_UPSAMPLE_MODE)mode);
+            scaledBook.init(width, height);
+            double agreement = 0.0, fgIou = 0.0;
+            const double scaledMs = benchScaledPsoBook(scaledBook, rgbFrames, masks, width,
+                                                       height, agreement, fgIou);
+            printf("double   rgb  1/%d %-7s   : %7.2f ms/frame, %7.1f fps, mask %6.2f%% "
+                   "equal to full size, foreground IoU %.3f.\n", scale,
+                   mode == MASK_UPSAMPLE_NEAREST ? "nearest" : "edge", scaledMs,
+                   1000.0 / scaledMs, agreement * 100.0, fgIou);
+        }
+    }
+    return 0;
+}
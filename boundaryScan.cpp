@@ -1,11 +1,235 @@
+#include <stdlib.h>
+#include <algorithm>
 #include "boundaryScan.h"
+#if defined(__x86_64__) || defined(__i386__)
+#define BOUNDARY_SCAN_X86 1
+#include <immintrin.h>
+#endif
 
 namespace Seg_Three
 {
+namespace
+{
+// a row's foreground (0xFF) bytes into BordersMem's bits, 16 bytes by a compare & movemask
+void packRowBits(const unsigned char * row, const int width, unsigned long long * words)
+{
+    memset(words, 0, (width + 63) / 64 * sizeof(unsigned long long));
+    int j = 0;
+#ifdef __SSE2__
+    const __m128i foreground = _mm_set1_epi8((char)0xFF);
+    for (/**/; j + 16 <= width; j += 16)
+    {
+        const unsigned int bits = _mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(row + j)), foreground));
+        words[j >> 6] |= (unsigned long long)bits << (j & 63);
+    }
+#endif
+    for (/**/; j < width; j++)
+        if (row[j] == 0xFF)
+            words[j >> 6] |= 1ull << (j & 63);
+}
+
+// a left (right) strip's columns of the image rows into BordersMem's bits: strip row k is
+// column firstColumn + k * columnStep (1 or -1), its bit j is image row firstRow + j. By
+// blocks of 16 rows: one 16 byte load per row covers all columns, its 0xFF bytes become a
+// 16 bit movemask, and the block's masks are transposed in registers, 8 a vector: a shift
+// moves a column's bit to the lanes' sign, and packing the lanes to bytes gathers the
+// signs for one more movemask, the column's 16 bits.
+void packColumnBits(const cv::Mat & binary, const int firstRow, const int rows,
+                    const int firstColumn, const int columnStep, const int columns,
+                    unsigned long long * words, const int wordsPerRow)
+{
+    memset(words, 0, wordsPerRow * columns * sizeof(unsigned long long));
+    int j = 0;
+#ifdef __SSE2__
+    const int loadColumn = columnStep > 0 ? firstColumn : firstColumn - 15;
+    if (columns <= 16 && loadColumn >= 0 && loadColumn + 16 <= binary.cols)
+    {
+        const __m128i foreground = _mm_set1_epi8((char)0xFF);
+        for (/**/; j + 16 <= rows; j += 16)
+        {
+            unsigned short masks[16];
+            for (int r = 0; r < 16; r++)
+                masks[r] = _mm_movemask_epi8(_mm_cmpeq_epi8(foreground, _mm_loadu_si128(
+                    (const __m128i *)(binary.ptr<uchar>(firstRow + j + r) + loadColumn))));
+            const __m128i lo = _mm_loadu_si128((const __m128i *)masks);
+            const __m128i hi = _mm_loadu_si128((const __m128i *)(masks + 8));
+            for (int k = 0; k < columns; k++)
+            {   // the column's bit in the masks
+                const int bit = columnStep > 0 ? k : 15 - k;
+                const __m128i shift = _mm_cvtsi32_si128(15 - bit);
+                const unsigned int bits = _mm_movemask_epi8(
+                    _mm_packs_epi16(_mm_sll_epi16(lo, shift), _mm_sll_epi16(hi, shift)));
+                words[k * wordsPerRow + (j >> 6)] |= (unsigned long long)bits << (j & 63);
+            }
+        }
+    }
+#endif
+    for (/**/; j < rows; j++)
+    {
+        const unsigned char * row = binary.ptr<uchar>(firstRow + j);
+        for (int k = 0; k < columns; k++)
+            if (row[firstColumn + k * columnStep] == 0xFF)
+                words[k * wordsPerRow + (j >> 6)] |= 1ull << (j & 63);
+    }
+}
+
+// the open / close sequence of processFrame, a step is a 2x2 erode (true) or dilate
+const bool M_MORPH_ERODES[] =
+{
+    false, false, true, true, // close: dilate then erode
+    true, true, false, false, // open: erode then dilate
+    false, false, true, true  // close again
+};
+enum {M_MORPH_STEPS = sizeof(M_MORPH_ERODES) / sizeof(M_MORPH_ERODES[0])};
+
+// M_MORPH_STEPS on a block of 4 words of a row, once the row pair is the same. Each step
+// ANDs (ORs) a pixel with its right neighbour, the block's last word's one in 'next', the
+// word after the block. Only next's low M_MORPH_STEPS bits reach the block, and they only
+// need the bits above them, so next steps as if it were the row's last word: its high bits
+// go wrong, but are dropped. lastPixel is the strip's last pixel, in its word (or 0): for
+// the erode, it has no neighbour and keeps its own value.
+inline void morphBlock(unsigned long long * c, unsigned long long next,
+                       const unsigned long long * lastPixel, const unsigned long long nextLast)
+{
+    static_assert(M_MORPH_STEPS < 64, "the steps read into the next word only");
+    unsigned long long c0 = c[0], c1 = c[1], c2 = c[2], c3 = c[3];
+    for (int s = 0; s < M_MORPH_STEPS; s++)
+    {
+        const unsigned long long r0 = (c0 >> 1) | (c1 << 63);
+        const unsigned long long r1 = (c1 >> 1) | (c2 << 63);
+        const unsigned long long r2 = (c2 >> 1) | (c3 << 63);
+        const unsigned long long r3 = (c3 >> 1) | (next << 63);
+        if (M_MORPH_ERODES[s])
+        {
+            c0 &= r0 | lastPixel[0];
+            c1 &= r1 | lastPixel[1];
+            c2 &= r2 | lastPixel[2];
+            c3 &= r3 | lastPixel[3];
+            next &= (next >> 1) | nextLast;
+        }
+        else
+        {
+            c0 |= r0;
+            c1 |= r1;
+            c2 |= r2;
+            c3 |= r3;
+            next |= next >> 1;
+        }
+    }
+    c[0] = c0;
+    c[1] = c1;
+    c[2] = c2;
+    c[3] = c3;
+}
+
+#ifdef BOUNDARY_SCAN_X86
+__attribute__((target("avx2")))
+void morphBlockAvx2(unsigned long long * c, unsigned long long next,
+                    const unsigned long long * lastPixel, const unsigned long long nextLast)
+{
+    __m256i block = _mm256_loadu_si256((const __m256i *)c);
+    const __m256i last = _mm256_loadu_si256((const __m256i *)lastPixel);
+    for (int s = 0; s < M_MORPH_STEPS; s++)
+    {
+        const bool bErode = M_MORPH_ERODES[s];
+        // words 1, 2, 3 & next, at 0, 1, 2, 3
+        const __m256i neighbours = _mm256_blend_epi32(
+            _mm256_permute4x64_epi64(block, 0xF9), _mm256_set1_epi64x(next), 0xC0);
+        __m256i right = _mm256_or_si256(_mm256_srli_epi64(block, 1),
+                                        _mm256_slli_epi64(neighbours, 63));
+        if (bErode)
+            block = _mm256_and_si256(block, _mm256_or_si256(right, last));
+        else
+            block = _mm256_or_si256(block, right);
+        next = bErode ? (next & ((next >> 1) | nextLast)) : (next | (next >> 1));
+    }
+    _mm256_storeu_si256((__m256i *)c, block);
+}
+#endif
+
+// all M_MORPH_STEPS on a row pair in one streaming pass, 4 words at a time in registers:
+// the first step makes both rows the AND (OR) of the pair. words is the rows' words, a
+// multiple of 4, the ones beyond the width are 0 & stay 0.
+void morphRowPair(unsigned long long * r0, unsigned long long * r1, const int width,
+                  const int words, const bool bAvx2)
+{
+    if (width < 2)
+        return; // no window fits
+    const int lastWord = (width - 1) >> 6;
+    const unsigned long long lastBit = 1ull << ((width - 1) & 63);
+    for (int w = 0; w < words; w += 4)
+    {
+        unsigned long long block[4];
+        unsigned long long lastPixel[4];
+        for (int i = 0; i < 4; i++)
+        {
+            block[i] = M_MORPH_ERODES[0] ? (r0[w+i] & r1[w+i]) : (r0[w+i] | r1[w+i]);
+            lastPixel[i] = w + i == lastWord ? lastBit : 0;
+        }
+        const unsigned long long next = w + 4 == words ? 0 :
+                                        (M_MORPH_ERODES[0] ? (r0[w+4] & r1[w+4]) :
+                                                             (r0[w+4] | r1[w+4]));
+        const unsigned long long nextLast = w + 4 == lastWord ? lastBit : 0;
+#ifdef BOUNDARY_SCAN_X86
+        if (bAvx2)
+            morphBlockAvx2(block, next, lastPixel, nextLast);
+        else
+#endif
+            morphBlock(block, next, lastPixel, nextLast);
+        memcpy(r0 + w, block, sizeof(block));
+        memcpy(r1 + w, block, sizeof(block));
+    }
+}
+
+// the foreground runs of a strip row, from the bits where it flips: edges gets each run's
+// [start, end), a run still open at the width is dropped as the byte scan did. Returns
+// the runs; edges needs room for the row's words * 64 + 1 flips.
+int extractRuns(const unsigned long long * row, const int width, int * edges)
+{
+    const int words = (width + 63) >> 6;
+    int n = 0;
+    unsigned long long carry = 0; // the previous word's last pixel
+    for (int w = 0; w < words; w++)
+    {
+        const unsigned long long word = row[w];
+        unsigned long long flips = word ^ ((word << 1) | carry);
+        carry = word >> 63;
+        for (; flips != 0; flips &= flips - 1)
+            edges[n++] = (w << 6) + __builtin_ctzll(flips);
+    }
+    n &= ~1; // a start with no end: the run reaches the last word's end
+    if (n > 0 && edges[n-1] >= width)
+        n -= 2; // ended by the 0 bits beyond the width
+    return n / 2;
+}
+
+// M_MORPH_STEPS on a row pair of 0 / 0xFF bytes, the 2x2 window sliding left to right as
+// the strips did before they were bits; for setScanCheck.
+void morphBytePair(unsigned char * r0, unsigned char * r1, const int width)
+{
+    for (int s = 0; s < M_MORPH_STEPS; s++)
+    {
+        for (int j = 0; j < width - 1; j++)
+        {
+            r0[j] = r1[j] = M_MORPH_ERODES[s] ? (r0[j] & r1[j] & r0[j+1] & r1[j+1]) :
+                                                (r0[j] | r1[j] | r0[j+1] | r1[j+1]);
+            if (j == width - 2) // the last pixel, only its own pair
+                r0[j+1] = r1[j+1] = M_MORPH_ERODES[s] ? (r0[j+1] & r1[j+1]) :
+                                                        (r0[j+1] | r1[j+1]);
+        }
+    }
+}
+} // namespace
+
 //////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////
 //// constructor / destructor / init
 BoundaryScan :: BoundaryScan()
+    : m_bMorphAvx2(getVectorKernelLevel() == VECTOR_KERNEL_AVX2)
+    , m_bScanCheck(false)
+    , m_checkedRuns(0)
+    , m_runMismatches(0)
 {
     return;
 }
@@ -29,13 +253,21 @@ int BoundaryScan :: init(const int width, const int height,
     m_scanSizeLR = scanSizeLR;
     m_takeFrameInterval = takeFrameInterval;
     //normaly heightTB=heightLR=2, widthTB=imgWidth, widthLR=imgHeight
-    m_bordersMem.init(m_imgWidth - 2 * skipTB, scanSizeTB,
-                      m_imgHeight - 2 * skipLR, scanSizeLR);
+    //the strips are the rows / columns between the skipped ones, as BgResult's mvs
+    m_bordersMem.init(m_imgWidth - 2 * skipLR, scanSizeTB,
+                      m_imgHeight - 2 * skipTB, scanSizeLR);
 
     // for caching part
     m_curFrontIdx = 0;
     for (int k=0; k < M_BOUNDARY_SCAN_CACHE_LINES; k++)
         m_cacheLines[k].resize(BORDER_NUM);
+    for (int k = 0; k < BORDER_NUM; k++)
+    {
+        const int borderWidth = k < 2 ? m_bordersMem.widthTB : m_bordersMem.widthLR;
+        m_xMvSums[k].assign(borderWidth + 1, 0.0);
+        m_yMvSums[k].assign(borderWidth + 1, 0.0);
+        m_runEdges[k].assign(((borderWidth + 63) >> 6) * 64 + 1, 0);
+    }
     return 0;    
 }
 
@@ -60,43 +292,31 @@ int BoundaryScan :: processFrame(BgResult & bgResult)
            (int)bgResult.binaryData.step[1] == (int)sizeof(unsigned char));
     assert(m_scanSizeTB == m_bordersMem.heightTB &&
            m_scanSizeLR == m_bordersMem.heightLR );
-    // 1. first extract border data from bgResult
+    // 1. first extract border data from bgResult, as bits
+    const int wordsTB = m_bordersMem.wordsTB, wordsLR = m_bordersMem.wordsLR;
     for (int k = 0; k < m_scanSizeTB; k++)
     {   // top & bottom data
-        memcpy(m_bordersMem.directions[0] + k*m_bordersMem.widthTB, // top
-               bgResult.binaryData.data + m_imgWidth * (k+m_skipTB) + m_skipLR, 
-               m_imgWidth - 2*m_skipLR); 
-        memcpy(m_bordersMem.directions[1] + k*m_bordersMem.widthTB, // bottom
-               bgResult.binaryData.data + m_imgWidth*(m_imgHeight-m_skipTB-k-1) + m_skipLR,
-               m_imgWidth - 2*m_skipLR);
-    }
-    // left & right data
-    for (int k = 0; k < m_scanSizeLR; k++)
-    {
-        for (int j = 0; j < m_bordersMem.widthLR; j++)
-        {   
-            m_bordersMem.directions[2][k*m_bordersMem.widthLR+j] = // left
-                bgResult.binaryData.at<uchar>(j+m_skipTB, k+m_skipLR);
-            m_bordersMem.directions[3][k*m_bordersMem.widthLR+j] = // right
-                bgResult.binaryData.at<uchar>(j+m_skipTB, m_imgWidth-m_skipLR-k-1);
-        }
+        packRowBits(bgResult.binaryData.ptr<uchar>(k+m_skipTB) + m_skipLR, // top
+                    m_bordersMem.widthTB, m_bordersMem.directions[0] + k*wordsTB);
+        packRowBits(bgResult.binaryData.ptr<uchar>(m_imgHeight-m_skipTB-k-1) + m_skipLR,
+                    m_bordersMem.widthTB, m_bordersMem.directions[1] + k*wordsTB); // bottom
     }
+    // left & right data: straight from the image rows, a block of them at a time
+    packColumnBits(bgResult.binaryData, m_skipTB, m_bordersMem.widthLR, m_skipLR, 1,
+                   m_scanSizeLR, m_bordersMem.directions[2], wordsLR); // left
+    packColumnBits(bgResult.binaryData, m_skipTB, m_bordersMem.widthLR,
+                   m_imgWidth - m_skipLR - 1, -1, m_scanSizeLR,
+                   m_bordersMem.directions[3], wordsLR); // right
     // 2. we do open / close: seems for simplified erode/dilate, just open is ok.    
-    //for (int k = 0; k < 2; k++)
-    {   
-        // close: dilate then erode
-        doDilate(2);
-        doErode(2);
-        //// oepn: erode then dilate
-        doErode(2);
-        doDilate(2);
-        //// close again
-        doDilate(2);
-        doErode(2);
-    }
+    //    close, open, close again (M_MORPH_ERODES), one pass over each strip.
+    morphBorders<false>();
+    morphBorders<true>();
     
     // 3. scan the boundary, get the TDPoint of the lines
+    buildMvSums(bgResult);
     scanBoundaryLines(bgResult);
+    if (m_bScanCheck)
+        checkScanByBytes(bgResult);
     // 4. do analyse those lines & do pre-merge (in one frame & one border line level)
     premergeLines(bgResult);
 
@@ -118,47 +338,113 @@ int BoundaryScan :: processFrame(BgResult & bgResult)
     return 0;
 }
 
+void BoundaryScan :: setKernelLevel(const VECTOR_KERNEL_LEVEL level)
+{
+    m_bMorphAvx2 = getVectorKernelLevel(level) == VECTOR_KERNEL_AVX2;
+    return;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////
 //// Important Internal Helpers
+// the frame's mvs summed up along each border, for getLineMoveAngle
+int BoundaryScan :: buildMvSums(const BgResult & bgResult)
+{
+    for (int index = 0; index < BORDER_NUM; index++)
+    {
+        const vector<double> & xMvs = bgResult.xMvs[index];
+        const vector<double> & yMvs = bgResult.yMvs[index];
+        vector<double> & xSums = m_xMvSums[index];
+        vector<double> & ySums = m_yMvSums[index];
+        assert(xMvs.size() + 1 >= xSums.size() && yMvs.size() + 1 >= ySums.size());
+        for (int k = 0; k + 1 < (int)xSums.size(); k++)
+        {
+            xSums[k+1] = xSums[k] + xMvs[k];
+            ySums[k+1] = ySums[k] + yMvs[k];
+        }
+    }
+    return 0;
+}
+
 int BoundaryScan :: scanBoundaryLines(const BgResult & bgResult)
 {
     // we get borders with erode/dilate, then we get the foreground bgResult.lines.
     LogI(" **** Scan the border %d times, curFrontIdx %d.\n", m_inputFrames, m_curFrontIdx);
     vector<vector<TDLine> > & cacheOneFramelines = m_cacheLines[m_curFrontIdx];
-    cacheOneFramelines.clear(); // important reset it here
     cacheOneFramelines.resize(BORDER_NUM);
     
     int width = m_bordersMem.widthTB;
     for (int index = 0; index < BORDER_NUM; index++)
     {
-        const vector<double> & xMvs = bgResult.xMvs[index];
-        const vector<double> & yMvs = bgResult.yMvs[index];        
         if (index >= 2) // for left/right borders
             width = m_bordersMem.widthLR;
 
-        TDLine line;
-        bool bStart = false;
-        for (int k = 0; k < width; k++)
+        // strip row 0's runs, then the lines in place: important reset them here, but
+        // keep the vectors' memory from the frames before.
+        int * edges = &m_runEdges[index][0];
+        const int runs = extractRuns(m_bordersMem.directions[index], width, edges);
+        vector<TDLine> & lines = cacheOneFramelines[index];
+        lines.clear();
+        lines.resize(runs);
+        for (int k = 0; k < runs; k++)
+        {
+            TDLine & line = lines[k];
+            line.a.x = edges[2*k];
+            line.a.y = 0;
+            line.b.x = edges[2*k+1];
+            line.b.y = 0;
+            line.movingAngle = getLineMoveAngle(line, index);
+            LogD("Get One '%s' Line, %d-%d(%.2f).\n",
+                 getMovingDirectionStr((MOVING_DIRECTION)index),
+                 line.a.x, line.b.x, line.movingAngle);
+        }
+    }
+    return 0;
+}
+
+// setScanCheck: the strips as 0 / 0xFF bytes, erode / dilate & the row 0 scan as before
+// the strips were bits, against the runs scanBoundaryLines got from the bits
+int BoundaryScan :: checkScanByBytes(const BgResult & bgResult)
+{
+    const cv::Mat & binary = bgResult.binaryData;
+    const vector<vector<TDLine> > & cacheOneFramelines = m_cacheLines[m_curFrontIdx];
+    for (int index = 0; index < BORDER_NUM; index++)
+    {
+        const int width = index < 2 ? m_bordersMem.widthTB : m_bordersMem.widthLR;
+        const int height = index < 2 ? m_scanSizeTB : m_scanSizeLR;
+        vector<unsigned char> strip(width * height);
+        for (int k = 0; k < height; k++)
         {
-            if (bStart == false && m_bordersMem.directions[index][k] == 0xFF)
+            for (int j = 0; j < width; j++)
             {
-                bStart = true;
-                line.a.x = k;
-                line.a.y = 0;
+                const int y = index == 0 ? m_skipTB + k :
+                              (index == 1 ? m_imgHeight - m_skipTB - k - 1 : m_skipTB + j);
+                const int x = index < 2 ? m_skipLR + j :
+                              (index == 2 ? m_skipLR + k : m_imgWidth - m_skipLR - k - 1);
+                strip[k*width + j] = binary.at<uchar>(y, x);
             }
-            if (bStart == true && m_bordersMem.directions[index][k] != 0xFF)
+        }
+        for (int k = 0; k + 1 < height; k += M_ELEMENT_HEIGHT)
+            morphBytePair(&strip[k*width], &strip[(k+1)*width], width);
+
+        // row 0's runs; one still open at the width has no end, so no line
+        vector<int> runs;
+        for (int j = 0, a = -1; j < width; j++)
+        {
+            if (a < 0 && strip[j] == 0xFF)
+                a = j;
+            else if (a >= 0 && strip[j] != 0xFF)
             {
-                bStart = false;
-                line.b.x = k;
-                line.b.y = 0;
-                line.movingAngle = getLineMoveAngle(line, xMvs, yMvs);
-                cacheOneFramelines[index].push_back(line);
-                LogD("Get One '%s' Line, %d-%d(%.2f).\n",
-                     getMovingDirectionStr((MOVING_DIRECTION)index),
-                     line.a.x, line.b.x, line.movingAngle);
-                bStart = false;
+                runs.push_back(a);
+                runs.push_back(j);
+                a = -1;
             }
         }
+        const vector<TDLine> & lines = cacheOneFramelines[index];
+        const int same = std::min((int)lines.size(), (int)runs.size() / 2);
+        m_checkedRuns += runs.size() / 2;
+        m_runMismatches += abs((int)lines.size() - (int)runs.size() / 2);
+        for (int k = 0; k < same; k++)
+            m_runMismatches += lines[k].a.x != runs[2*k] || lines[k].b.x != runs[2*k+1];
     }
     return 0;
 }
@@ -184,9 +470,6 @@ int BoundaryScan :: premergeLines(const BgResult & bgResult)
         vector<TDLine> & oneBoundaryLines = cacheFramelines[index];
         if (oneBoundaryLines.size() < 2) // no need merging
             continue;
-        const vector<double> & xMvs = bgResult.xMvs[index];
-        const vector<double> & yMvs = bgResult.yMvs[index];
-        
         for (auto it = oneBoundaryLines.begin(); it != oneBoundaryLines.end(); /*No increment*/)
         {
             auto nextIt = it + 1;
@@ -202,7 +485,7 @@ int BoundaryScan :: premergeLines(const BgResult & bgResult)
                 if (ret == 1)
                 {
                     it->b = nextIt->b;
-                    it->movingAngle = getLineMoveAngle(*it, xMvs, yMvs);
+                    it->movingAngle = getLineMoveAngle(*it, index);
                     oneBoundaryLines.erase(nextIt);
                     LogD("---- Merged New Line is %d-%d(%.2f).\n",
                          it->a.x, it->b.x, it->movingAngle);
@@ -210,7 +493,7 @@ int BoundaryScan :: premergeLines(const BgResult & bgResult)
                 else if (ret == 2)
                 {
                     it->b = lookAheadIt->b;
-                    it->movingAngle = getLineMoveAngle(*it, xMvs, yMvs);                    
+                    it->movingAngle = getLineMoveAngle(*it, index);                    
                     oneBoundaryLines.erase(lookAheadIt);
                     oneBoundaryLines.erase(nextIt);
                     LogD("---- Merged New Line is %d-%d(%.2f).\n",
@@ -400,9 +683,7 @@ int BoundaryScan :: goMarking(const int bdNum, BgResult & bgResult,
     const double averageAngle = (curLine.movingAngle +
                                  middleLines[middleMaxIdx].movingAngle) / 2.0;
     
-    const vector<double> & xMvs = bgResult.xMvs[bdNum];
-    const vector<double> & yMvs = bgResult.yMvs[bdNum];
-    const double updateAngle = getLineMoveAngle(curLine, xMvs, yMvs);
+    const double updateAngle = getLineMoveAngle(curLine, bdNum);
     if (curLine.b.x - curLine.a.x >=
         middleLines[middleMaxIdx].b.x - middleLines[middleMaxIdx].a.x)
         curLine.movingAngle = updateAngle;
@@ -433,16 +714,12 @@ int BoundaryScan :: goMarking(const int bdNum, BgResult & bgResult,
 //////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////
 //// Trival Inner Helpers    
-// return [-pi, pi]
-double BoundaryScan :: getLineMoveAngle(const TDLine & l1, const vector<double> & xMvs,
-                                        const vector<double> & yMvs)
+// return [-pi, pi]: the angle of the mvs summed over the line, both ends included
+double BoundaryScan :: getLineMoveAngle(const TDLine & l1, const int bdNum)
 {
-    double xMv = 0.0, yMv = 0.0;
-    for (int k = l1.a.x; k <= l1.b.x; k++)
-    {
-        xMv += xMvs[k];
-        yMv += yMvs[k];
-    }
+    assert(l1.a.x >= 0 && l1.b.x + 1 < (int)m_xMvSums[bdNum].size());
+    const double xMv = m_xMvSums[bdNum][l1.b.x + 1] - m_xMvSums[bdNum][l1.a.x];
+    const double yMv = m_yMvSums[bdNum][l1.b.x + 1] - m_yMvSums[bdNum][l1.a.x];
     return atan2(yMv, xMv);
 }
 
@@ -481,76 +758,20 @@ int BoundaryScan :: calcLineMovingStatus(const int bdNum, TDLine & line)
     return 0;
 }
 
-//simplified Erode/dilate
-int BoundaryScan :: doErode(const int times)
-{
-    // NOTE: following code just deal with 2x2 window! Be aware of it.
-    for (int t = 0; t < times; t++)
-    {
-        int width = m_bordersMem.widthTB, height = m_bordersMem.heightTB;
-        for (int n = 0; n < 4; n++)
-        {   // note k = k + M_ELEMENT_HEIGHT
-            if (n >= 2)
-            {
-                width = m_bordersMem.widthLR;            
-                height = m_bordersMem.heightLR;
-            }
-         
-            for (int k = 0; k < height; k+=M_ELEMENT_HEIGHT)
-            {
-                for (int j = 0; j < width - 1; j++)
-                {
-                    m_bordersMem.directions[n][k*width + j] =
-                      m_bordersMem.directions[n][(k+1)*width + j] =
-                        m_bordersMem.directions[n][k*width + j]     &
-                        m_bordersMem.directions[n][(k+1)*width + j] &
-                        m_bordersMem.directions[n][k*width + j+1]   & 
-                        m_bordersMem.directions[n][(k+1)*width + j+1];
-                    if (j == width - M_ELEMENT_WIDTH)
-                        m_bordersMem.directions[n][k*width + j+1] =
-                            m_bordersMem.directions[n][(k+1)*width + j+1] =
-                                m_bordersMem.directions[n][k*width + j+1]   &
-                                m_bordersMem.directions[n][(k+1)*width + j+1];
-                    //if (m_bordersMem.directions[n][k*width + j] == 0xFF)
-                    //    LogI("One point 255, x=%d, y=%d\n", j, k);
-                }
-            }
-        }
-    }
-    return 0;
-}
-
-int BoundaryScan :: doDilate(const int times)
+//simplified Erode/dilate, on the packed strips: 64 pixels a word operation. NOTE: just
+//deal with 2x2 window! The top & bottom (bLR false) or left & right strips, compiled for
+//the one orientation.
+template <bool bLR>
+int BoundaryScan :: morphBorders()
 {
-    for (int t = 0; t < times; t++)
-    {
-        int width = m_bordersMem.widthTB, height = m_bordersMem.heightTB;        
-        for (int n = 0; n < 4; n++)
-        {   // note k = k + M_ELEMENT_HEIGHT
-            if (n >= 2)
-            {
-                height = m_bordersMem.heightLR;
-                width = m_bordersMem.widthLR;
-            }
-            for (int k = 0; k < height; k+=M_ELEMENT_HEIGHT)
-            {
-                for (int j = 0; j < width - 1; j++)
-                {
-                    m_bordersMem.directions[n][k*width + j] =
-                      m_bordersMem.directions[n][(k+1)*width + j] =
-                        m_bordersMem.directions[n][k*width + j]     |
-                        m_bordersMem.directions[n][(k+1)*width + j] |
-                        m_bordersMem.directions[n][k*width + j+1]   | 
-                        m_bordersMem.directions[n][(k+1)*width + j+1];
-                    if (j == width - M_ELEMENT_WIDTH)
-                        m_bordersMem.directions[n][k*width + j+1] =
-                            m_bordersMem.directions[n][(k+1)*width + j+1] =
-                                m_bordersMem.directions[n][k*width + j+1]   |
-                                m_bordersMem.directions[n][(k+1)*width + j+1];
-                }
-            }
-        }
-    }
+    const int width = bLR ? m_bordersMem.widthLR : m_bordersMem.widthTB;
+    const int height = bLR ? m_bordersMem.heightLR : m_bordersMem.heightTB;
+    const int words = bLR ? m_bordersMem.wordsLR : m_bordersMem.wordsTB;
+    for (int n = bLR ? 2 : 0; n < (bLR ? 4 : 2); n++)
+        for (int k = 0; k + 1 < height; k+=M_ELEMENT_HEIGHT) // note k = k + M_ELEMENT_HEIGHT
+            morphRowPair(m_bordersMem.directions[n] + k*words,
+                         m_bordersMem.directions[n] + (k+1)*words, width, words,
+                         m_bMorphAvx2);
     return 0;
 }
 
@@ -37,8 +37,19 @@ public:
              const int scanSizeTB, const int scanSizeLR,
              const int takeFrameInterval);
     int processFrame(BgResult & bgResult);
+    // the morphology on AVX2 (256 bit blocks) if 'level' & the cpu allow, else on 64 bit
+    // words; the result is the same.
+    void setKernelLevel(const VECTOR_KERNEL_LEVEL level);
+    // also extract, erode / dilate & scan each frame byte by byte, as before the strips were
+    // bits, and count the runs that differ from the bit path's
+    void setScanCheck(const bool bScanCheck) {m_bScanCheck = bScanCheck;}
+    long getCheckedRuns() const {return m_checkedRuns;}
+    long getRunMismatches() const {return m_runMismatches;}
 
 private: // inner classes
+    // border strips as bitsets: each strip row is a run of 64 bit words, pixel j is bit
+    // j % 64 of word j / 64, set for a foreground (0xFF) pixel. The bits & words beyond the
+    // width are kept 0, so the words need no masking.
     class BordersMem
     {
     public:
@@ -59,18 +70,26 @@ private: // inner classes
             heightTB = _heightTB;                
             widthLR = _widthLR;
             heightLR = _heightLR;                
-            directions[0] = new unsigned char[widthTB * heightTB];
-            directions[1] = new unsigned char[widthTB * heightTB];
-            directions[2] = new unsigned char[widthLR * heightLR];
-            directions[3] = new unsigned char[widthLR * heightLR];
+            wordsTB = (widthTB + 255) / 256 * 4;
+            wordsLR = (widthLR + 255) / 256 * 4;
+            directions[0] = new unsigned long long[wordsTB * heightTB]();
+            directions[1] = new unsigned long long[wordsTB * heightTB]();
+            directions[2] = new unsigned long long[wordsLR * heightLR]();
+            directions[3] = new unsigned long long[wordsLR * heightLR]();
         }        
+        bool isForeground(const int n, const int k) const
+        {
+            return (directions[n][k >> 6] >> (k & 63)) & 1;
+        }
     public:
         int widthTB;
         int widthLR;
         int heightTB;
         int heightLR;
+        int wordsTB; // a strip row's words, by 4 for the morphology's 256 bit blocks
+        int wordsLR;
         // top bottom left right
-        unsigned char *directions[BORDER_NUM];        
+        unsigned long long *directions[BORDER_NUM];        
     };
 
 private: // inner members
@@ -90,8 +109,19 @@ private: // inner members
     BordersMem m_bordersMem;
     int m_curFrontIdx;
     vector<vector<TDLine> > m_cacheLines[M_BOUNDARY_SCAN_CACHE_LINES];    
+    // prefix sums of the frame's mvs per border, sums[k] of mvs [0, k): a line's motion
+    // is two subtractions, however long it is & however often it is merged.
+    vector<double> m_xMvSums[BORDER_NUM];
+    vector<double> m_yMvSums[BORDER_NUM];
+    // scanBoundaryLines' run [start, end) pairs per border, sized once for the most runs
+    vector<int> m_runEdges[BORDER_NUM];
+    bool m_bMorphAvx2;
+    bool m_bScanCheck;
+    long m_checkedRuns; // only counted with m_bScanCheck
+    long m_runMismatches;
 
 private: // important inner helpers
+    int buildMvSums(const BgResult & bgResult);
     int scanBoundaryLines(const BgResult & bgResult);
     int premergeLines(const BgResult & bgResult);
     int canLinesBeMerged(const TDLine & l1, const TDLine & l2, const TDLine & l3);
@@ -102,14 +132,14 @@ private: // important inner helpers
                                     vector<TDLine> & oldLines);
     int goMarking(const int bdNum, BgResult & bgResult,
                   TDLine & curLine, vector<TDLine> & middleLines, vector<TDLine> & oldLines);
+    int checkScanByBytes(const BgResult & bgResult);
                   
 
 private: // trival inner helpers
-    int doErode(const int times = 1);
-    int doDilate(const int times = 1);
+    template <bool bLR>
+    int morphBorders();
     int mergeOverlapOfOnePositionLines(vector<TDLine> & lines, const int curIdx);
-    double getLineMoveAngle(const TDLine & l1,
-                            const vector<double> & xMvs, const vector<double> & yMvs);
+    double getLineMoveAngle(const TDLine & l1, const int bdNum);
     int calcLineMovingStatus(const int bdBum, TDLine & line);
     inline bool isLineCloseEnough(const double diffAngle)
     {
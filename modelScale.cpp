@@ -0,0 +1,201 @@
+// sys
+#include <algorithm>
+#include <assert.h>
+#include <stdlib.h>
+// project
+#include "modelScale.h"
+
+namespace Seg_Three
+{
+namespace
+{
+// add one input row into the model row's channel sums; full cells unrolled by the
+// template, the partial cell at the right border, if any, after them.
+template <int CHANNELS, int SCALE>
+void addRowToCells(const unsigned char * x, const int width, unsigned int * sums)
+{
+    const int fullCells = width / SCALE;
+    for (int mj = 0; mj < fullCells; mj++, x += CHANNELS * SCALE, sums += CHANNELS)
+    {   // in registers, not a load/add/store chain through sums
+        for (int c = 0; c < CHANNELS; c++)
+        {
+            unsigned int sum = 0;
+            for (int n = 0; n < SCALE; n++)
+                sum += x[n * CHANNELS + c];
+            sums[c] += sum;
+        }
+    }
+    for (int n = 0; n < width - fullCells * SCALE; n++)
+        for (int c = 0; c < CHANNELS; c++)
+            sums[c] += x[n * CHANNELS + c];
+    return;
+}
+
+typedef void (*AddRowToCells)(const unsigned char * x, const int width, unsigned int * sums);
+
+AddRowToCells selectAddRowToCells(const int channels, const int scale)
+{
+    if (channels == 1)
+        return scale == 2 ? addRowToCells<1, 2> : addRowToCells<1, 4>;
+    return scale == 2 ? addRowToCells<3, 2> : addRowToCells<3, 4>;
+}
+} // namespace
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//// ModelScaler class method
+int ModelScaler :: init(const int width, const int height, const int channels,
+                        const int scale)
+{
+    if (scale != 1 && scale != 2 && scale != 4)
+        return -1;
+    if (channels != 1 && channels != 3)
+        return -1;
+    m_width = width;
+    m_height = height;
+    m_channels = channels;
+    m_scale = scale;
+    // a partial cell at the right/bottom border averages the pixels it has
+    m_modelWidth = (m_width + m_scale - 1) / m_scale;
+    m_modelHeight = (m_height + m_scale - 1) / m_scale;
+    if (m_scale > 1)
+    {
+        m_modelIn.create(m_modelHeight, m_modelWidth, m_channels == 3 ? CV_8UC3 : CV_8UC1);
+        m_modelMask.create(m_modelHeight, m_modelWidth, CV_8UC1);
+        m_rowSums.assign(m_modelWidth * m_channels, 0);
+        m_edgeCells.assign(m_modelWidth * m_modelHeight, 0);
+    }
+    return 0;
+}
+
+const cv::Mat & ModelScaler :: downsample(const cv::Mat & in)
+{
+    assert(in.cols == m_width && in.rows == m_height && in.channels() == m_channels);
+    const AddRowToCells addRow = selectAddRowToCells(m_channels, m_scale);
+    const int channels = m_channels;
+    for (int mk = 0; mk < m_modelHeight; mk++)
+    {
+        const int rowBegin = mk * m_scale;
+        const int rowEnd = std::min(rowBegin + m_scale, m_height);
+        std::fill(m_rowSums.begin(), m_rowSums.end(), 0);
+        for (int k = rowBegin; k < rowEnd; k++)
+            addRow(in.ptr<unsigned char>(k), m_width, &m_rowSums[0]);
+
+        unsigned char * y = m_modelIn.ptr<unsigned char>(mk);
+        const int fullCells = m_width / m_scale;
+        int mj = 0;
+        if (rowEnd - rowBegin == m_scale) // full cells: area is scale^2, a shift
+        {
+            const int shift = m_scale == 2 ? 2 : 4;
+            for (/**/; mj < fullCells * channels; mj++)
+                y[mj] = (m_rowSums[mj] + (1 << (shift - 1))) >> shift;
+            mj = fullCells;
+        }
+        for (/**/; mj < m_modelWidth; mj++)
+        {
+            const int area = (rowEnd - rowBegin) *
+                             (std::min((mj + 1) * m_scale, m_width) - mj * m_scale);
+            for (int c = 0; c < channels; c++)
+                y[mj * channels + c] = (m_rowSums[mj * channels + c] + area / 2) / area;
+        }
+    }
+    return m_modelIn;
+}
+
+void ModelScaler :: upsample(const cv::Mat & in, cv::Mat & out)
+{
+    assert(out.cols == m_width && out.rows == m_height && out.channels() == 1);
+    if (m_upsampleMode == MASK_UPSAMPLE_EDGE)
+    {
+        findEdgeCells();
+        for (int k = 0; k < m_height; k++)
+            upsampleEdgeRow(in, k, out.ptr<unsigned char>(k));
+        return;
+    }
+    for (int k = 0; k < m_height; k++)
+    {
+        unsigned char * o = out.ptr<unsigned char>(k);
+        if (k % m_scale != 0) // the same model row as the row above
+        {
+            memcpy(o, out.ptr<unsigned char>(k - 1), m_width);
+            continue;
+        }
+        const unsigned char * m = m_modelMask.ptr<unsigned char>(k / m_scale);
+        for (int mj = 0, j = 0; mj < m_modelWidth; mj++)
+            for (const int jEnd = std::min(j + m_scale, m_width); j < jEnd; j++)
+                o[j] = m[mj];
+    }
+    return;
+}
+
+void ModelScaler :: findEdgeCells()
+{
+    for (int mk = 0; mk < m_modelHeight; mk++)
+    {
+        const unsigned char * up = m_modelMask.ptr<unsigned char>(std::max(mk - 1, 0));
+        const unsigned char * m = m_modelMask.ptr<unsigned char>(mk);
+        const unsigned char * down =
+            m_modelMask.ptr<unsigned char>(std::min(mk + 1, m_modelHeight - 1));
+        unsigned char * edge = &m_edgeCells[mk * m_modelWidth];
+        for (int mj = 0; mj < m_modelWidth; mj++)
+        {
+            const int left = std::max(mj - 1, 0);
+            const int right = std::min(mj + 1, m_modelWidth - 1);
+            const unsigned char v = m[mj];
+            edge[mj] = (up[left] != v || up[mj] != v || up[right] != v ||
+                        m[left] != v || m[right] != v ||
+                        down[left] != v || down[mj] != v || down[right] != v) ? 1 : 0;
+        }
+    }
+    return;
+}
+
+// pixels of a cell whose 3x3 cells all agree take its value; on a mask edge a pixel takes
+// the value of the neighbour cell whose averaged color is the nearest to its own, so the
+// edge follows the image instead of the cell grid.
+void ModelScaler :: upsampleEdgeRow(const cv::Mat & in, const int k, unsigned char * out)
+{
+    const int channels = m_channels;
+    const int mk = k / m_scale;
+    const int mkBegin = std::max(mk - 1, 0);
+    const int mkEnd = std::min(mk + 2, m_modelHeight);
+    const unsigned char * x = in.ptr<unsigned char>(k);
+    const unsigned char * m = m_modelMask.ptr<unsigned char>(mk);
+    const unsigned char * edge = &m_edgeCells[mk * m_modelWidth];
+    for (int mj = 0, j = 0; mj < m_modelWidth; mj++)
+    {
+        const int jEnd = std::min(j + m_scale, m_width);
+        if (edge[mj] == 0)
+        {
+            for (/**/; j < jEnd; j++)
+                out[j] = m[mj];
+            continue;
+        }
+        const int mjBegin = std::max(mj - 1, 0);
+        const int mjEnd = std::min(mj + 2, m_modelWidth);
+        for (/**/; j < jEnd; j++)
+        {
+            int minDistance = 0x7FFFFFFF;
+            for (int r = mkBegin; r < mkEnd; r++)
+            {
+                const unsigned char * y = m_modelIn.ptr<unsigned char>(r);
+                const unsigned char * mr = m_modelMask.ptr<unsigned char>(r);
+                for (int q = mjBegin; q < mjEnd; q++)
+                {
+                    int distance = 0;
+                    for (int c = 0; c < channels; c++)
+                        distance += abs(x[j * channels + c] - y[q * channels + c]);
+                    // ties keep the pixel's own cell
+                    if (distance < minDistance ||
+                        (distance == minDistance && r == mk && q == mj))
+                    {
+                        minDistance = distance;
+                        out[j] = mr[q];
+                    }
+                }
+            }
+        }
+    }
+    return;
+}
+
+} // namespace Seg_Three
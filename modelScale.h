@@ -0,0 +1,64 @@
+#ifndef _MODEL_SCALE_H_
+#define _MODEL_SCALE_H_
+
+// sys
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+// tools - just using Mat
+#include <opencv2/core/core.hpp>
+
+// namespace
+using :: std :: vector;
+
+namespace Seg_Three
+{
+//////////////////////////////////////////////////////////////////////////////////////////
+//// Reduced resolution modelling: the background model runs on a 1/scale frame (each
+//// scale x scale cell area averaged), and its mask is scaled back to the input size.
+//// The masks only feed box level logic, so 1/2 or 1/4 of the resolution is enough and
+//// the modelling work drops by scale^2.
+enum MASK_UPSAMPLE_MODE
+{
+    MASK_UPSAMPLE_NEAREST = 0, // each cell's mask value on all its pixels
+    MASK_UPSAMPLE_EDGE         // on mask edges, a pixel takes the neighbour cell closest in color
+};
+
+class ModelScaler
+{
+public:
+    ModelScaler()
+        : m_width(0), m_height(0), m_channels(0), m_scale(1)
+        , m_modelWidth(0), m_modelHeight(0), m_upsampleMode(MASK_UPSAMPLE_NEAREST)
+    {}
+    // scale: 1 (off), 2 or 4
+    int init(const int width, const int height, const int channels, const int scale);
+    bool isEnabled() const {return m_scale > 1;}
+    void setUpsampleMode(const MASK_UPSAMPLE_MODE mode) {m_upsampleMode = mode;}
+    int getModelWidth() const {return m_modelWidth;}
+    int getModelHeight() const {return m_modelHeight;}
+    // the model's input & output, valid until the next frame
+    const cv::Mat & downsample(const cv::Mat & in);
+    cv::Mat & getModelMask() {return m_modelMask;}
+    // getModelMask() back to the input size; in is the frame given to downsample.
+    void upsample(const cv::Mat & in, cv::Mat & out);
+
+private:
+    int m_width;
+    int m_height;
+    int m_channels;
+    int m_scale;
+    int m_modelWidth;
+    int m_modelHeight;
+    MASK_UPSAMPLE_MODE m_upsampleMode;
+    cv::Mat m_modelIn;
+    cv::Mat m_modelMask;
+    vector<unsigned int> m_rowSums; // one model row of channel sums
+    vector<unsigned char> m_edgeCells; // model cells whose 3x3 cells' mask differ
+    void findEdgeCells();
+    void upsampleEdgeRow(const cv::Mat & in, const int k, unsigned char * out);
+};
+
+} // namespace Seg_Three
+
+#endif // _MODEL_SCALE_H_
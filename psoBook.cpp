@@ -1,66 +1,75 @@
 #include <algorithm>
+#include <boost/bind.hpp>
 #include "psoBook.h"
 
 namespace Seg_Three
 {
-//// helpers
-double distanceToProbability(const double distance)
+namespace
 {
-    if (distance <= 20)
-        return 1.0 - distance * 0.005;
-    else if (distance <= 200)
-        return 1.0 - (distance * 0.001 + 0.4);
-    else if (distance < 400)
-        return distance * 0.0005 * (-1.0) + 0.3;
-    else
-        return 0.0;
+//// snapshot payload: the planes of the model type, in PsoModelStore's order.
+struct PlaneWriter
+{
+    SnapshotWriter & writer;
+    template <typename T>
+    int operator()(vector<T> & plane) {return writer.writeVector(plane);}
+};
+
+struct PlaneReader
+{
+    SnapshotReader & reader;
+    template <typename T>
+    int operator()(vector<T> & plane) {return reader.readVector(plane);}
+};
+
+template <class PlaneIo>
+int ioModelPlanes(PlaneIo io, PsoModelStore & store)
+{
+    int ret = 0;
+    for (int c = 0; c < store.channels; c++)
+        ret |= io(store.lastInputs[c]);
+    if (store.type == PSO_MODEL_COMPACT)
+    {
+        for (int c = 0; c < store.channels; c++)
+            ret |= io(store.bgWeights16[c]) | io(store.movingWeights16[c]);
+        return ret | io(store.bgScores16) | io(store.movingScores16);
+    }
+    for (int c = 0; c < store.channels; c++)
+        ret |= io(store.bgWeights[c]) | io(store.movingWeights[c]);
+    return ret | io(store.bgScores) | io(store.movingScores) | io(store.ages);
 }
+} // namespace
 
 //////////////////////////////////////////////////////////////////////////////////////////
 //// PsoNN class method
-double PsoNN :: processOneInput(const double input)
-{
-    return 0.0;
-    //m_inputFrames++;
-    //m_lastInput = input;
-    //if (m_inputFrames == 1)
-    //    m_bgNeuron.setWeightVector(input);
-    // 
-    //const double bgDistance = grayEulerDistance(m_bgNeuron.getWeightVector(), input);
-    //const double movingDistance = grayEulerDistance(m_movingNeuron.getWeightVector(), input);
-    //const double bgProbability = distanceToProbability(bgDistance);
-    //const double movingProbability = distanceToProbability(movingDistance);
-    //return movingProbability > bgProbability ? (1 - movingProbability) : bgProbability;
-}
-    
-double PsoNN :: processOneInput(const VectorSpace<double> & input)
+double PsoNN :: processOneInput(const unsigned char * input, const bool bFirstInput)
 {
-    m_inputFrames++;
-    m_lastInputVector = input;
-    if (m_inputFrames == 1)
-        m_bgNeuron.setWeightVector(input);
+    if (m_store.type == PSO_MODEL_COMPACT)
+        return processOneInputCompact(input, bFirstInput);
+    for (int c = 0; c < m_store.channels; c++)
+    {
+        m_store.lastInputs[c][m_idx] = input[c];
+        if (bFirstInput)
+            m_store.bgWeights[c][m_idx] = input[c];
+    }
     
-    const double bgDistance = VectorSpace<double>::
-                              rgbEulerDistance(m_bgNeuron.getWeightVector(), input);
-    const double movingDistance = VectorSpace<double>::
-                                  rgbEulerDistance(m_movingNeuron.getWeightVector(), input);    
-    const double bgProbability = distanceToProbability(bgDistance);
-    const double movingProbability = distanceToProbability(movingDistance);
+    double distances[2];
+    distancesToNeurons(input, distances);
+    const double bgProbability = distanceToProbability(distances[0]);
+    const double movingProbability = distanceToProbability(distances[1]);
     return movingProbability > bgProbability ? (1 - movingProbability) : bgProbability;
 }
 
 int PsoNN :: updateNeuron(const bool bBg)
 {
-    if (bBg)
-    {
-        m_bgNeuron.updateAsWinner(m_lastInputVector);
-        m_movingNeuron.updateAsLoser();
-    }
-    else
-    {
-        m_movingNeuron.updateAsWinner(m_lastInputVector);
-        m_bgNeuron.updateAsLoser();
-    }
+    if (m_store.type == PSO_MODEL_COMPACT)
+        return updateNeuronCompact(bBg);
+    unsigned int & winnerScores = bBg ? m_store.bgScores[m_idx] : m_store.movingScores[m_idx];
+    unsigned int & loserScores = bBg ? m_store.movingScores[m_idx] : m_store.bgScores[m_idx];
+    updateWeightsAsWinner(bBg ? m_store.bgWeights : m_store.movingWeights);
+    winnerScores++;
+    if (loserScores > 0)
+        loserScores--;
+    m_store.ages[m_idx]++;
 
     // change
     //if (m_bgNeuron.getScores() < m_movingNeuron.getScores())
@@ -71,107 +80,439 @@ int PsoNN :: updateNeuron(const bool bBg)
     return 0;
 }
 
+int PsoNN :: ageNeuron(const bool bBg, const unsigned int frames)
+{
+    // blending by 0.5 has converged after 64 rounds (17 for 8.8 fixed point)
+    if (m_store.type == PSO_MODEL_COMPACT)
+    {
+        vector<unsigned short> * weights = bBg ? m_store.bgWeights16 : m_store.movingWeights16;
+        for (int c = 0; c < m_store.channels; c++)
+        {
+            unsigned short & w = weights[c][m_idx];
+            const int x = m_store.lastInputs[c][m_idx] << PSO_FIXED_SHIFT;
+            for (unsigned int n = 0; n < frames && n < 17; n++)
+                w = (w + x) >> 1;
+        }
+        unsigned short & winnerScores = bBg ? m_store.bgScores16[m_idx] :
+                                              m_store.movingScores16[m_idx];
+        unsigned short & loserScores = bBg ? m_store.movingScores16[m_idx] :
+                                             m_store.bgScores16[m_idx];
+        winnerScores = std::min(0xFFFFu, winnerScores + frames);
+        loserScores = loserScores > frames ? loserScores - frames : 0;
+        return 0;
+    }
+    for (unsigned int n = 0; n < frames && n < 64; n++)
+        updateWeightsAsWinner(bBg ? m_store.bgWeights : m_store.movingWeights);
+    unsigned int & winnerScores = bBg ? m_store.bgScores[m_idx] : m_store.movingScores[m_idx];
+    unsigned int & loserScores = bBg ? m_store.movingScores[m_idx] : m_store.bgScores[m_idx];
+    winnerScores += frames;
+    loserScores = loserScores > frames ? loserScores - frames : 0;
+    m_store.ages[m_idx] += frames;
+    return 0;
+}
+
+void PsoNN :: distancesToNeurons(const unsigned char * input, double * distances)
+{
+    if (m_store.channels == 1)
+    {
+        distances[0] = grayEulerDistance(m_store.bgWeights[0][m_idx], input[0]);
+        distances[1] = grayEulerDistance(m_store.movingWeights[0][m_idx], input[0]);
+        return;
+    }
+    const PsoVector weights[2] =
+    {
+        PsoVector(m_store.bgWeights[0][m_idx], m_store.bgWeights[1][m_idx],
+                  m_store.bgWeights[2][m_idx]),
+        PsoVector(m_store.movingWeights[0][m_idx], m_store.movingWeights[1][m_idx],
+                  m_store.movingWeights[2][m_idx])
+    };
+    const PsoVector x((double)input[0], (double)input[1], (double)input[2]);
+    PsoVector::rgbEulerDistances(x, weights, 2, distances);
+}
+
+void PsoNN :: updateWeightsAsWinner(vector<double> * weights)
+{
+    for (int c = 0; c < m_store.channels; c++)
+    {
+        double & w = weights[c][m_idx];
+        w = w + ((m_store.lastInputs[c][m_idx] - w) * 0.5);
+    }
+}
+
+//// PSO_MODEL_COMPACT: weights in 8.8 fixed point, probability looked up by the squared
+//// distance. Blending by 0.5 is a shift, losing the lowest fraction bit each time.
+double PsoNN :: processOneInputCompact(const unsigned char * input, const bool bFirstInput)
+{
+    for (int c = 0; c < m_store.channels; c++)
+    {
+        m_store.lastInputs[c][m_idx] = input[c];
+        if (bFirstInput)
+            m_store.bgWeights16[c][m_idx] = input[c] << PSO_FIXED_SHIFT;
+    }
+
+    static const float * lut = getPsoProbabilityLut();
+    const double bgProbability =
+        squaredDistanceToProbability(lut, squaredDistanceToWeights(m_store.bgWeights16, input));
+    const double movingProbability =
+        squaredDistanceToProbability(lut, squaredDistanceToWeights(m_store.movingWeights16,
+                                                                   input));
+    return movingProbability > bgProbability ? (1 - movingProbability) : bgProbability;
+}
+
+int PsoNN :: updateNeuronCompact(const bool bBg)
+{
+    vector<unsigned short> * weights = bBg ? m_store.bgWeights16 : m_store.movingWeights16;
+    for (int c = 0; c < m_store.channels; c++)
+    {
+        unsigned short & w = weights[c][m_idx];
+        w = (w + (m_store.lastInputs[c][m_idx] << PSO_FIXED_SHIFT)) >> 1;
+    }
+    unsigned short & winnerScores = bBg ? m_store.bgScores16[m_idx] :
+                                          m_store.movingScores16[m_idx];
+    unsigned short & loserScores = bBg ? m_store.movingScores16[m_idx] :
+                                         m_store.bgScores16[m_idx];
+    if (winnerScores < 0xFFFF)
+        winnerScores++;
+    if (loserScores > 0)
+        loserScores--;
+    return 0;
+}
+
+int PsoNN :: squaredDistanceToWeights(const vector<unsigned short> * weights,
+                                      const unsigned char * input)
+{
+    if (m_store.channels == 1)
+        return graySquaredDistanceFixed(weights[0][m_idx], input[0]);
+    unsigned short w[PSO_MAX_CHANNELS];
+    for (int c = 0; c < m_store.channels; c++)
+        w[c] = weights[c][m_idx];
+    return rgbSquaredDistanceFixed(w, input);
+}
 
 //////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////
 //// PsoBook class method
 int PsoBook :: processFrameRgb(const cv::Mat & in, cv::Mat & out)
+{
+    assert(in.channels() == 3 && m_store.channels == 3);
+    return m_scaler.isEnabled() ? processScaledFrame(in, out) : processFrame(in, out);
+}
+
+int PsoBook :: processFrameGray(const cv::Mat & in, cv::Mat & out)
+{
+    assert(in.channels() == 1 && m_store.channels == 1);
+    return m_scaler.isEnabled() ? processScaledFrame(in, out) : processFrame(in, out);
+}
+
+int PsoBook :: processScaledFrame(const cv::Mat & in, cv::Mat & out)
+{
+    const int ret = processFrame(m_scaler.downsample(in), m_scaler.getModelMask());
+    m_scaler.upsample(in, out);
+    return ret;
+}
+
+int PsoBook :: processFrame(const cv::Mat & in, cv::Mat & out)
 {
     assert(in.cols == m_imgWidth && in.rows == m_imgHeight);
     assert(out.cols == m_imgWidth && out.rows == m_imgHeight);
-    assert(in.channels() == 3 && out.channels() ==1);
+    assert(out.channels() ==1);
     m_inputFrames++;
-    vector<double> selfProbabilty(m_imgWidth * m_imgHeight, 0.0);
+    if (m_tileGate.isEnabled())
+        m_tileGate.update(in);
+    if (m_bStreaming)
+    {   // bands exchange their edge rows' probabilities before any neuron is updated
+        m_threadPool.parallelFor(m_bandNum, boost::bind(&PsoBook::classifyBandEdges, this,
+                                                        _1, boost::cref(in)));
+        m_threadPool.parallelFor(m_bandNum, boost::bind(&PsoBook::streamBand, this, _1,
+                                                        boost::cref(in), boost::ref(out)));
+    }
+    else
+    {
+        vector<double> selfProbabilty(m_imgWidth * m_imgHeight, 0.0);
+        // bands only touch their own rows; the refine pass reads one halo row of the
+        // neighbour bands, which are all classified after the first parallelFor returns.
+        m_threadPool.parallelFor(m_bandNum, boost::bind(&PsoBook::classifyBand, this, _1,
+                                                        boost::cref(in),
+                                                        boost::ref(selfProbabilty)));
+        m_threadPool.parallelFor(m_bandNum, boost::bind(&PsoBook::refineBand, this, _1,
+                                                        boost::cref(selfProbabilty),
+                                                        boost::ref(out)));
+    }
+    if (m_tileGate.isEnabled())
+        m_tileGate.applyMask(out);
+    // the bands counted their own, the threads are done with them now
+    long mismatches = 0;
+    for (int band = 0; band < m_bandNum; band++)
+    {
+        mismatches += m_bandMismatches[band];
+        m_bandMismatches[band] = 0;
+    }
+    m_kernelMismatches += mismatches;
+    if (mismatches > 0)
+        LogW("Frame %d: %s kernel differs from scalar on %ld pixels.\n", m_inputFrames,
+             getKernelStr(), mismatches);
+    return 1;
+}
 
-    for (int k = 0; k < m_imgHeight; k++)
+// classify one row into p. With change gating only the columns some active tile's refine
+// reads are classified, the rest of p is left as it is. Returns the kernel mismatches.
+int PsoBook :: classifyRow(const int k, const unsigned char * in, const bool bFirstInput,
+                           double * p)
+{
+    if (m_tileGate.isEnabled() == false)
+        return classifySpan(k, 0, m_imgWidth, in, bFirstInput, p);
+    const int tileSize = m_tileGate.getTileSize();
+    const int tileCols = m_tileGate.getTileCols();
+    int mismatches = 0;
+    for (int tc = 0; tc < tileCols; /* No Increment */)
     {
-        for (int j = 0; j < m_imgWidth; j++)
+        if (m_tileGate.isRowClassified(k, tc) == false)
         {
-            vector<double> input;
-            const cv::Vec3b & intensity = in.at<cv::Vec3b>(k, j);
-            for(int n=0; n < in.channels(); n++)
-                input.push_back(intensity[n]);
-            selfProbabilty[k*m_imgWidth+j] =
-                m_pPsos[k][j]->processOneInput(VectorSpace<double>(input));
-            out.at<uchar>(k, j) = 0;
+            tc++;
+            continue;
         }
+        int tcEnd = tc + 1;
+        while (tcEnd < tileCols && m_tileGate.isRowClassified(k, tcEnd))
+            tcEnd++;
+        mismatches += classifySpan(k, std::max(0, tc * tileSize - 1),
+                                   std::min(m_imgWidth, tcEnd * tileSize + 1), in,
+                                   bFirstInput, p);
+        tc = tcEnd;
     }
-    
-    return refineNetsByCollectiveWisdom(selfProbabilty, out);
+    return mismatches;
 }
 
-int PsoBook :: processFrameGray(const cv::Mat & in, cv::Mat & out)
+// classify columns [colBegin, colEnd) of row k, with the SIMD row kernel if there is one.
+// in & p point to the row start. Returns the pixels the kernel differs from the scalar path
+// on, in PSO_KERNEL_CHECK mode; the bands run it at once, so they count their own.
+int PsoBook :: classifySpan(const int k, const int colBegin, const int colEnd,
+                            const unsigned char * in, const bool bFirstInput, double * p)
 {
-    assert(in.cols == m_imgWidth && in.rows == m_imgHeight);
-    assert(out.cols == m_imgWidth && out.rows == m_imgHeight);
-    assert(in.channels() == 1 && out.channels() ==1);
-    m_inputFrames++;
-    vector<double> selfProbabilty(m_imgWidth * m_imgHeight, 0.0);
+    const int channels = m_store.channels;
+    const int rowIdx = k * m_imgWidth + colBegin;
+    const int width = colEnd - colBegin;
+    in += colBegin * channels;
+    p += colBegin;
+    const bool bCompact = m_store.type == PSO_MODEL_COMPACT;
+    if (bCompact ? m_compactRowKernel == NULL : m_rowKernel == NULL)
+    {
+        for (int j = 0; j < width; j++)
+            p[j] = PsoNN(m_store, rowIdx + j).processOneInput(in + j * channels, bFirstInput);
+        return 0;
+    }
 
-    for (int k = 0; k < m_imgHeight; k++)
+    // the kernels only read the store, do the per pixel writes first
+    for (int c = 0; c < channels; c++)
+    {
+        unsigned char * lastInputs = &m_store.lastInputs[c][rowIdx];
+        for (int j = 0; j < width; j++)
+            lastInputs[j] = in[j * channels + c];
+        if (bFirstInput && bCompact)
+            for (int j = 0; j < width; j++)
+                m_store.bgWeights16[c][rowIdx + j] = in[j * channels + c] << PSO_FIXED_SHIFT;
+        else if (bFirstInput)
+            for (int j = 0; j < width; j++)
+                m_store.bgWeights[c][rowIdx + j] = in[j * channels + c];
+    }
+    if (bCompact)
     {
-        for (int j = 0; j < m_imgWidth; j++)
+        const unsigned short * bg[PSO_MAX_CHANNELS] = {NULL, NULL, NULL};
+        const unsigned short * moving[PSO_MAX_CHANNELS] = {NULL, NULL, NULL};
+        for (int c = 0; c < channels; c++)
         {
-            selfProbabilty[k*m_imgWidth+j] =
-                m_pPsos[k][j]->processOneInput(out.at<uchar>(k, j));
-            out.at<uchar>(k, j) = 0;
+            bg[c] = &m_store.bgWeights16[c][rowIdx];
+            moving[c] = &m_store.movingWeights16[c][rowIdx];
         }
+        m_compactRowKernel(in, bg, moving, width, p);
     }
-    
-    return refineNetsByCollectiveWisdom(selfProbabilty, out);
+    else
+    {
+        const double * bg[PSO_MAX_CHANNELS] = {NULL, NULL, NULL};
+        const double * moving[PSO_MAX_CHANNELS] = {NULL, NULL, NULL};
+        for (int c = 0; c < channels; c++)
+        {
+            bg[c] = &m_store.bgWeights[c][rowIdx];
+            moving[c] = &m_store.movingWeights[c][rowIdx];
+        }
+        m_rowKernel(in, bg, moving, width, p);
+    }
+
+    int mismatches = 0;
+    if (m_kernelMode == PSO_KERNEL_CHECK)
+        for (int j = 0; j < width; j++)
+            if (PsoNN(m_store, rowIdx + j).processOneInput(in + j * channels, false) != p[j])
+                mismatches++;
+    return mismatches;
 }
+
+// change gating: tiles processed again after being skipped catch up on the skipped
+// frames first, with the winner of their last mask.
+void PsoBook :: ageSkippedNeurons(const int rowBegin, const int rowEnd)
+{
+    if (m_tileGate.isEnabled() == false)
+        return;
+    const int tileSize = m_tileGate.getTileSize();
+    for (int k = rowBegin; k < rowEnd; k++)
+    {
+        const unsigned char * lastMask = m_tileGate.getLastMask(k);
+        for (int tc = 0; tc < m_tileGate.getTileCols(); tc++)
+        {
+            const unsigned int frames = m_tileGate.getPendingFrames(k, tc);
+            if (m_tileGate.isRowActive(k, tc) == false || frames == 0)
+                continue;
+            const int colEnd = std::min((tc + 1) * tileSize, m_imgWidth);
+            for (int j = tc * tileSize; j < colEnd; j++)
+                PsoNN(m_store, k * m_imgWidth + j).ageNeuron(lastMask[j] == 0, frames);
+        }
+    }
+    return;
+}
+
+int PsoBook :: classifyBand(const int band, const cv::Mat & in, vector<double> & p)
+{
+    int rowBegin = 0, rowEnd = 0;
+    getBandRows(band, rowBegin, rowEnd);
+    ageSkippedNeurons(rowBegin, rowEnd);
+    for (int k = rowBegin; k < rowEnd; k++)
+        m_bandMismatches[band] += classifyRow(k, in.ptr<unsigned char>(k),
+                                              m_inputFrames == 1, &p[k*m_imgWidth]);
+    return 0;
+}
+
+int PsoBook :: refineBand(const int band, const vector<double> & p, cv::Mat & out)
+{
+    int rowBegin = 0, rowEnd = 0;
+    getBandRows(band, rowBegin, rowEnd);
+    return refineNetsByCollectiveWisdom(p, out, rowBegin, rowEnd);
+}
+
+// streaming: classify the first & last row of the band before any neuron update, so the
+// neighbour bands can take them as halo rows.
+int PsoBook :: classifyBandEdges(const int band, const cv::Mat & in)
+{
+    int rowBegin = 0, rowEnd = 0;
+    getBandRows(band, rowBegin, rowEnd);
+    ageSkippedNeurons(rowBegin, rowEnd);
+    double * edges = &m_bandEdgeRows[band * 2 * m_imgWidth];
+    m_bandMismatches[band] += classifyRow(rowBegin, in.ptr<unsigned char>(rowBegin),
+                                          m_inputFrames == 1, edges);
+    m_bandMismatches[band] += classifyRow(rowEnd - 1, in.ptr<unsigned char>(rowEnd - 1),
+                                          m_inputFrames == 1, edges + m_imgWidth);
+    return 0;
+}
+
+// streaming: row k is refined & its neurons updated as soon as row k+1 is classified.
+int PsoBook :: streamBand(const int band, const cv::Mat & in, cv::Mat & out)
+{
+    int rowBegin = 0, rowEnd = 0;
+    getBandRows(band, rowBegin, rowEnd);
+    const int width = m_imgWidth;
+    double * window = &m_rowWindows[band * 3 * width];
+    const double * edges = &m_bandEdgeRows[band * 2 * width];
     
+    const double * pUp = band > 0 ? &m_bandEdgeRows[((band - 1) * 2 + 1) * width] : NULL;
+    const double * pCur = edges;
+    for (int k = rowBegin; k < rowEnd; k++)
+    {
+        const double * pDown = NULL;
+        if (k + 1 == rowEnd - 1)
+            pDown = edges + width;
+        else if (k + 1 < rowEnd)
+        {
+            double * pNext = window + ((k + 1 - rowBegin) % 3) * width;
+            m_bandMismatches[band] += classifyRow(k + 1, in.ptr<unsigned char>(k + 1),
+                                                  m_inputFrames == 1, pNext);
+            pDown = pNext;
+        }
+        else if (k + 1 < m_imgHeight)
+            pDown = &m_bandEdgeRows[(band + 1) * 2 * width];
+
+        refineRow(pUp, pCur, pDown, k, out.ptr<unsigned char>(k));
+        pUp = pCur;
+        pCur = pDown;
+    }
+    return 0;
+}
+
+void PsoBook :: getBandRows(const int band, int & rowBegin, int & rowEnd)
+{
+    rowBegin = (int)((long)m_imgHeight * band / m_bandNum);
+    rowEnd = (int)((long)m_imgHeight * (band + 1) / m_bandNum);
+}
+
 // it seems this can be done by Erode/Dilate    
-int PsoBook :: refineNetsByCollectiveWisdom(const vector<double> & p, cv::Mat & out)
+int PsoBook :: refineNetsByCollectiveWisdom(const vector<double> & p, cv::Mat & out,
+                                            const int rowBegin, const int rowEnd)
+{
+    const int width = m_imgWidth;
+    for (int k = rowBegin; k < rowEnd; k++)
+        refineRow(k > 0 ? &p[(k-1)*width] : NULL, &p[k*width],
+                  k < m_imgHeight - 1 ? &p[(k+1)*width] : NULL,
+                  k, out.ptr<unsigned char>(k));
+    return 1;
+}
+
+// one row of the 3x3 weighted sum, then mark bg & foreground and update the neurons.
+// pUp/pDown are NULL for the top/bottom row. With change gating only the active tiles
+// are refined, applyMask fills in the skipped ones.
+int PsoBook :: refineRow(const double * pUp, const double * p, const double * pDown,
+                         const int k, unsigned char * out)
+{
+    if (m_tileGate.isEnabled() == false)
+        return refineSpan(pUp, p, pDown, k, 0, m_imgWidth, out);
+    const int tileSize = m_tileGate.getTileSize();
+    for (int tc = 0; tc < m_tileGate.getTileCols(); tc++)
+        if (m_tileGate.isRowActive(k, tc))
+            refineSpan(pUp, p, pDown, k, tc * tileSize,
+                       std::min((tc + 1) * tileSize, m_imgWidth), out);
+    return 1;
+}
+
+// columns [colBegin, colEnd) of refineRow. Weights & summing order are those of the
+// original whole frame version, including its bottom row never refining (width - 2).
+int PsoBook :: refineSpan(const double * pUp, const double * p, const double * pDown,
+                          const int k, const int colBegin, const int colEnd,
+                          unsigned char * out)
 {
-    vector<double> finalP(m_imgWidth * m_imgHeight, 0.0);
-    // for top/bottom border
     const int width = m_imgWidth;
-    const int height = m_imgHeight;
-    const int leftBottom = width * (height -1);
-    const int rightBottom = width * height - 1;
-    finalP[0] = p[0] + 0.2 * (p[1] + p[width] + p[width + 1]);
-    finalP[width-1] = p[width-1] + 0.2*
-                      (p[width-1-1] + p[2*width-1] + p[2*(width-1)]);
-    finalP[leftBottom] = p[leftBottom] + 0.2*
-                         (p[leftBottom+1] + p[leftBottom-width] + p[leftBottom-width+1]);
-    finalP[rightBottom] = p[rightBottom] + 0.2*
-                          (p[rightBottom-1] + p[rightBottom-width] + p[rightBottom-width-1]);
-
-    for (int k = 1; k < width - 1; k++)
-        finalP[k] = p[k] + 0.15 * (p[k-1] + p[k+1] + 
-                             p[width + k-1] + p[width + k] + p[width + k+1]);    
-    for (int k = leftBottom+1; k < rightBottom-1; k++)
-        finalP[k] = p[k] + 0.15 * (p[k-1] + p[k+1] + 
-                             p[k-1-width] + p[k-width] + p[k+1-width]);
-
-    // for  left/right border
-    for (int k = 1; k < height - 1; k++)
-        finalP[k*width] = p[k*width] + 0.15 * (p[k*width+1] + p[(k-1)*width] +
-                               p[(k-1)*width+1] + p[(k+1)*width] + p[(k+1)*width+1]);
-
-    for (int k = 1; k < height - 1; k++)
-        finalP[(k+1)*width-1] = p[(k+1)*width-1] + 
-            0.15 * (p[(k+1)*width-1-1] + p[k*width-1] + p[k*width-1-1] +
-                    p[(k+2)*width-1] + p[(k+2)*width-1-1]);
-
-    // for inside area
-    for (int k = 1; k < height - 1; k++)
-        for (int j = 1; j < width - 1; j++)
-            finalP[k*width + j] = p[k*width + j] + 
-                0.1 * (p[k*width + j-1] + p[k*width + j-1] +
-                p[(k-1) * width + j-1] + p[(k-1) * width + j] + p[(k-1) * width + j+1] +
-                p[(k+1) * width + j-1] + p[(k+1) * width + j] + p[(k+1) * width + j+1]); 
-
-    // mark bg & foreground
-    for (int k = 0; k < height; k++)
-    {
-        for (int j = 0; j < width; j++)   
+    double finalP = 0.0;
+    for (int j = colBegin; j < colEnd; j++)
+    {
+        if (pUp == NULL) // top border
         {
-            const bool bBg = finalP[k*width+j] > M_COLLECTIVE_WISDOM_THREATHOLD;
-            out.at<uchar>(k, j) = bBg ? 0 : 255;
-            m_pPsos[k][j]->updateNeuron(bBg);
+            if (j == 0)
+                finalP = p[0] + 0.2 * (p[1] + pDown[0] + pDown[1]);
+            else if (j == width - 1)
+                finalP = p[j] + 0.2 * (p[j-1] + pDown[j] + pDown[j-1]);
+            else
+                finalP = p[j] + 0.15 * (p[j-1] + p[j+1] +
+                                        pDown[j-1] + pDown[j] + pDown[j+1]);
         }
+        else if (pDown == NULL) // bottom border
+        {
+            if (j == 0)
+                finalP = p[0] + 0.2 * (p[1] + pUp[0] + pUp[1]);
+            else if (j == width - 1)
+                finalP = p[j] + 0.2 * (p[j-1] + pUp[j] + pUp[j-1]);
+            else if (j == width - 2)
+                finalP = 0.0;
+            else
+                finalP = p[j] + 0.15 * (p[j-1] + p[j+1] +
+                                        pUp[j-1] + pUp[j] + pUp[j+1]);
+        }
+        else if (j == 0) // left border
+            finalP = p[0] + 0.15 * (p[1] + pUp[0] + pUp[1] + pDown[0] + pDown[1]);
+        else if (j == width - 1) // right border
+            finalP = p[j] + 0.15 * (p[j-1] + pUp[j] + pUp[j-1] + pDown[j] + pDown[j-1]);
+        else // inside area
+            finalP = p[j] + 0.1 * (p[j-1] + p[j-1] +
+                                   pUp[j-1] + pUp[j] + pUp[j+1] +
+                                   pDown[j-1] + pDown[j] + pDown[j+1]);
+
+        // mark bg & foreground
+        const bool bBg = finalP > M_COLLECTIVE_WISDOM_THREATHOLD;
+        out[j] = bBg ? 0 : 255;
+        PsoNN(m_store, k*width+j).updateNeuron(bBg);
     }
     
     return 1;
@@ -182,36 +523,138 @@ int PsoBook :: refineNetsByCollectiveWisdom(const vector<double> & p, cv::Mat &
 //// constructor / destructor / init
 PsoBook :: ~PsoBook()
 {
-    if (m_bInit == true)
-        for (int k = 0; k < m_imgHeight; k++)
-            for (int j = 0; j < m_imgWidth; j++)
-                if (m_pPsos[k][j] != NULL)
-                    delete m_pPsos[k][j];
     return;        
 }
 
-int PsoBook :: init(const int width, const int height)
+int PsoBook :: init(const int width, const int height, const int channels)
 {
     if (m_bInit == false)
     {
-        m_imgWidth = width;
-        m_imgHeight = height;
+        if (m_scaler.init(width, height, channels, m_modelScale) < 0)
+            return -1;
+        m_imgWidth = m_scaler.getModelWidth();
+        m_imgHeight = m_scaler.getModelHeight();
         m_inputFrames = 0;
-         
-        for (int k = 0; k < m_imgHeight; k++)
-        {
-            vector<PsoNN *> row;
-            for (int j = 0; j < m_imgWidth; j++)
-            {
-                PsoNN * pPsoNN = new PsoNN(k * m_imgWidth + j);
-                row.push_back(pPsoNN);
-            }
-            m_pPsos.push_back(row);
-        }
+        m_store.init(m_imgWidth * m_imgHeight, channels, m_modelType);
+        setKernelMode(m_kernelMode);
+        allocRowBuffers();
+        m_tileGate.init(m_imgWidth, m_imgHeight, channels, m_gateTileSize, m_gateTolerance);
         m_bInit = true;    
     }
 
     return 0;
 }
+
+void PsoBook :: setKernelMode(const PSO_KERNEL_MODE mode)
+{
+    m_kernelMode = mode;
+    m_rowKernel = m_store.channels == 1 ? selectPsoGrayRowKernel(mode) :
+                                          selectPsoRowKernel(mode);
+    m_compactRowKernel = selectPsoCompactRowKernel(mode, m_store.channels);
+}
+
+int PsoBook :: setModelType(const PSO_MODEL_TYPE type)
+{
+    if (m_bInit == true)
+        return -1;
+    m_modelType = type;
+    return 0;
+}
+
+int PsoBook :: setModelScale(const int scale)
+{
+    if (m_bInit == true || (scale != 1 && scale != 2 && scale != 4))
+        return -1;
+    m_modelScale = scale;
+    return 0;
+}
+
+int PsoBook :: setChangeGating(const int tileSize, const int tolerance)
+{
+    if (tileSize < 0 || (tileSize > 0 && tileSize < 4) || tolerance < 0)
+        return -1;
+    m_gateTileSize = tileSize;
+    m_gateTolerance = tolerance;
+    if (m_bInit == true)
+        return m_tileGate.init(m_imgWidth, m_imgHeight, m_store.channels, tileSize, tolerance);
+    return 0;
+}
+
+int PsoBook :: setThreadNum(const int threadNum)
+{
+    if (threadNum < 1 || m_threadPool.init(threadNum) < 0)
+        return -1;
+    m_bandNum = threadNum;
+    allocRowBuffers();
+    return 0;
+}
+
+int PsoBook :: saveSnapshot(const string & path)
+{
+    if (m_bInit == false)
+        return -1;
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.modelKind = SNAPSHOT_PSO_BOOK;
+    header.version = PSO_SNAPSHOT_VERSION;
+    header.modelType = m_store.type;
+    header.width = m_imgWidth;
+    header.height = m_imgHeight;
+    header.channels = m_store.channels;
+    header.inputFrames = m_inputFrames;
+
+    SnapshotWriter writer;
+    if (writer.open(path, header) < 0)
+        return -1;
+    PlaneWriter planeWriter = {writer};
+    if (ioModelPlanes(planeWriter, m_store) != 0)
+    {
+        LogE("Write PsoBook snapshot %s failed.\n", path.c_str());
+        return -1;
+    }
+    return writer.commit();
+}
+
+int PsoBook :: loadSnapshot(const string & path)
+{
+    if (m_bInit == false)
+        return -1;
+    SnapshotReader reader;
+    if (reader.open(path, SNAPSHOT_PSO_BOOK, PSO_SNAPSHOT_VERSION) < 0)
+        return -1;
+    const SnapshotHeader & header = reader.header();
+    if (header.width != m_imgWidth || header.height != m_imgHeight ||
+        header.channels != m_store.channels || header.modelType != (unsigned)m_store.type)
+    {
+        LogW("PsoBook snapshot %s is %dx%dx%d type %u, the book is %dx%dx%d type %d.\n",
+             path.c_str(), header.width, header.height, header.channels, header.modelType,
+             m_imgWidth, m_imgHeight, m_store.channels, m_store.type);
+        return -1;
+    }
+    // read into a scratch store, so a short file leaves the model untouched
+    PsoModelStore store;
+    store.init(m_store.pixels, m_store.channels, m_store.type);
+    PlaneReader planeReader = {reader};
+    if (ioModelPlanes(planeReader, store) != 0)
+    {
+        LogW("PsoBook snapshot %s is truncated.\n", path.c_str());
+        return -1;
+    }
+    std::swap(m_store, store);
+    m_inputFrames = header.inputFrames;
+    m_tileGate.reset();
+    return 0;
+}
+
+void PsoBook :: allocRowBuffers()
+{
+    if (m_imgWidth <= 0) // not init yet
+        return;
+    m_bandNum = std::max(1, std::min(m_bandNum, m_imgHeight));
+    m_rowWindows.assign(m_bandNum * 3 * m_imgWidth, 0.0);
+    m_bandEdgeRows.assign(m_bandNum * 2 * m_imgWidth, 0.0);
+    m_bandMismatches.assign(m_bandNum, 0);
+    return;
+}
     
 } // namespace Seg_Three
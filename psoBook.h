@@ -14,6 +14,11 @@
 // project
 #include "segUtil.h"
 #include "vectorSpace.h"
+#include "psoKernel.h"
+#include "threadPool.h"
+#include "segSnapshot.h"
+#include "tileGate.h"
+#include "modelScale.h"
 
 // namespace
 using :: std :: string;
@@ -24,100 +29,205 @@ namespace Seg_Three
 {
 
 enum {MAX_MEMORY_AGES = (25 * 1)}; // 25fps * 1s
+enum {PSO_MAX_CHANNELS = 3};
+typedef VectorSpace<double, PSO_MAX_CHANNELS> PsoVector; // an rgb input or weight vector
+enum {PSO_SNAPSHOT_VERSION = 1};
+enum PSO_MODEL_TYPE
+{
+    PSO_MODEL_DOUBLE = 0, // double weights
+    PSO_MODEL_COMPACT     // 8.8 fixed point weights, 16 bit scores, table probability
+};
 //////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////
-class Neuron
+// All pixels' neurons in planar (structure of arrays) layout: one plane per channel for
+// the bg/moving weight vectors and the last input, plus score & age planes. Indexed by
+// pixel idx (k * width + j), so a frame pass is a linear sweep over each plane.
+// Only the planes of the model type are allocated.
+struct PsoModelStore
 {
-public:    
-    explicit Neuron (const VectorSpace<double> & vs = 
-                           VectorSpace<double>(vector<double>(3, 0.0)))
-        : m_weightVector(vs)
-        , m_liveTimes(0)
-        , m_scores(0)        
+    PsoModelStore() : pixels(0), channels(0), type(PSO_MODEL_DOUBLE) {}
+    void init(const int _pixels, const int _channels, const PSO_MODEL_TYPE _type)
     {
-    
-    }    
-    ~Neuron(){}
-   
-    // apis
-    void updateAsLoser()
-    {        
-        m_scores--;
-        if (m_scores < 0) m_scores = 0;
-        m_liveTimes++;
+        assert(_channels > 0 && _channels <= PSO_MAX_CHANNELS);
+        pixels = _pixels;
+        channels = _channels;
+        type = _type;
+        const bool bDouble = type == PSO_MODEL_DOUBLE;
+        for (int c = 0; c < channels; c++)
+        {
+            bgWeights[c].assign(bDouble ? pixels : 0, 0.0);
+            movingWeights[c].assign(bDouble ? pixels : 0, 0.0);
+            bgWeights16[c].assign(bDouble ? 0 : pixels, 0);
+            movingWeights16[c].assign(bDouble ? 0 : pixels, 0);
+            lastInputs[c].assign(pixels, 0);
+        }
+        bgScores.assign(bDouble ? pixels : 0, 0);
+        movingScores.assign(bDouble ? pixels : 0, 0);
+        ages.assign(bDouble ? pixels : 0, 0);
+        bgScores16.assign(bDouble ? 0 : pixels, 0);
+        movingScores16.assign(bDouble ? 0 : pixels, 0);
     }
-    void updateAsWinner(const VectorSpace<double> & input) 
-    {   
-        //m_weightVector = input;
-        m_weightVector = m_weightVector + ((input - m_weightVector) * 0.5);
-        m_scores++;
-        m_liveTimes++;
-    }
-
-    void reset() 
+    size_t bytes() const
     {
-        m_weightVector = VectorSpace<double>(vector<double>(3, 0.0));
-        m_liveTimes = 0;
-        m_scores = 0;
+        if (type == PSO_MODEL_COMPACT)
+            return (size_t)pixels * (channels * (2 * sizeof(unsigned short) +
+                                                 sizeof(unsigned char)) +
+                                     2 * sizeof(unsigned short));
+        return (size_t)pixels * (channels * (2 * sizeof(double) + sizeof(unsigned char)) +
+                                 3 * sizeof(unsigned int));
     }
 
-    void setWeightVector(const VectorSpace<double> & vs) {m_weightVector = vs;}
-    VectorSpace<double> & getWeightVector() {return m_weightVector;}    
-    void setAges(const int newAges) {m_liveTimes = newAges;}
-    unsigned int getAges() {return m_liveTimes;}
-    void setScores(const int newScores) {m_scores = newScores;}
-    unsigned int getScores() {return m_scores;}
-
-private:
-    VectorSpace<double> m_weightVector;
-    unsigned int m_liveTimes;
-    unsigned int m_scores;
+    int pixels;
+    int channels;
+    PSO_MODEL_TYPE type;
+    vector<unsigned char> lastInputs[PSO_MAX_CHANNELS];
+    // PSO_MODEL_DOUBLE
+    vector<double> bgWeights[PSO_MAX_CHANNELS];
+    vector<double> movingWeights[PSO_MAX_CHANNELS];
+    vector<unsigned int> bgScores;
+    vector<unsigned int> movingScores;
+    vector<unsigned int> ages; // bg & moving neurons are aged together
+    // PSO_MODEL_COMPACT: ages are just the frame count, no plane for them
+    vector<unsigned short> bgWeights16[PSO_MAX_CHANNELS];
+    vector<unsigned short> movingWeights16[PSO_MAX_CHANNELS];
+    vector<unsigned short> bgScores16;
+    vector<unsigned short> movingScores16;
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////
-// class PSO Neural Network
+// class PSO Neural Network: a light view of one pixel's bg & moving neurons in the store.
 class PsoNN
 {
 public:
-    explicit PsoNN(const int idx) 
-        : m_idx(idx)
-        , m_inputFrames(0)
-        , m_lastInputVector(VectorSpace<double> (vector<double>(3, 0.0)))
+    PsoNN(PsoModelStore & store, const int idx)
+        : m_store(store)
+        , m_idx(idx)
     { 
         return;
     }
     // calculate PsoNN's output, update internal neurons' states.
-    double processOneInput(const VectorSpace<double> & input);
-    double processOneInput(const double input);    
+    // input has the store's channels: BGR, or one gray value.
+    double processOneInput(const unsigned char * input, const bool bFirstInput);
     int updateNeuron(const bool bBg);
+    // lazy aging: the updates of 'frames' skipped frames the same neuron won, at once.
+    int ageNeuron(const bool bBg, const unsigned int frames);
 
 private:
+    PsoModelStore & m_store;
     const int m_idx;
-    Neuron m_bgNeuron;
-    Neuron m_movingNeuron;
-    unsigned int m_inputFrames;
-    double m_lastInput;
-    VectorSpace<double> m_lastInputVector;
+    // the input's distances to the bg & the moving neuron, in one call
+    void distancesToNeurons(const unsigned char * input, double * distances);
+    void updateWeightsAsWinner(vector<double> * weights);
+    // PSO_MODEL_COMPACT
+    double processOneInputCompact(const unsigned char * input, const bool bFirstInput);
+    int updateNeuronCompact(const bool bBg);
+    int squaredDistanceToWeights(const vector<unsigned short> * weights,
+                                 const unsigned char * input);
 };
 
 class PsoBook
 {
 public:
-    PsoBook() : m_bInit(false) {};
+    PsoBook()
+        : m_bInit(false)
+        , m_imgWidth(0)
+        , m_imgHeight(0)
+        , m_modelType(PSO_MODEL_DOUBLE)
+        , m_kernelMode(PSO_KERNEL_AUTO)
+        , m_rowKernel(selectPsoRowKernel(PSO_KERNEL_AUTO))
+        , m_compactRowKernel(NULL)
+        , m_kernelMismatches(0)
+        , m_bandNum(1)
+        , m_bStreaming(true)
+        , m_gateTileSize(0)
+        , m_gateTolerance(0)
+        , m_modelScale(1)
+    {};
     ~PsoBook();    
     // API
-    int init(const int width, const int height);
+    // channels: 3 for processFrameRgb, 1 for processFrameGray.
+    int init(const int width, const int height, const int channels = 3);
     int processFrameGray(const cv::Mat & in, cv::Mat & out);
     int processFrameRgb(const cv::Mat & in, cv::Mat & out);
+    size_t getModelBytes() const {return m_store.bytes();}
+    // SIMD row kernel of processFrameRgb/Gray; PSO_KERNEL_CHECK also compares with scalar.
+    void setKernelMode(const PSO_KERNEL_MODE mode);
+    const char * getKernelStr() const
+    {
+        if (m_store.type == PSO_MODEL_COMPACT)
+            return getPsoCompactKernelStr(m_compactRowKernel);
+        return getPsoKernelStr(m_rowKernel);
+    }
+    long getKernelMismatches() const {return m_kernelMismatches;}
+    // PSO_MODEL_COMPACT: ~3.3x less model memory (19 vs 63 bytes a rgb pixel) for the
+    // probability of the whole distance. With the AVX2 integer kernel it is also faster
+    // than PSO_MODEL_DOUBLE; without AVX2 its scalar row is slower than the double SIMD
+    // kernels (there is no SSE4 integer one). Before init.
+    int setModelType(const PSO_MODEL_TYPE type);
+    // process frames in threadNum horizontal bands; the mask is the same as one thread's.
+    int setThreadNum(const int threadNum);
+    // classify/refine/update row by row through a three row window instead of whole
+    // frame passes; no frame sized temporaries, the same mask. On by default.
+    void setStreamingMode(const bool bStreaming) {m_bStreaming = bStreaming;}
+    // the learned model (all planes & the frame count) to/from a snapshot file; load
+    // needs an init'ed book of the same size, channels & model type.
+    int saveSnapshot(const string & path);
+    int loadSnapshot(const string & path);
+    // skip tileSize x tileSize tiles whose mean absolute difference to the input they were
+    // last processed with is <= tolerance: their mask is kept & their neurons aged lazily.
+    // tileSize 0 (default) turns it off.
+    int setChangeGating(const int tileSize, const int tolerance);
+    // of the last frame
+    double getSkippedTileFraction() const {return m_tileGate.getSkippedFraction();}
+    // model a 1/scale (1, 2 or 4) area averaged frame and scale the mask back up; before
+    // init. Tiles of change gating are in model pixels then.
+    int setModelScale(const int scale);
+    void setMaskUpsampleMode(const MASK_UPSAMPLE_MODE mode) {m_scaler.setUpsampleMode(mode);}
     
 private:
     bool m_bInit;
-    int m_imgWidth;
+    int m_imgWidth;  // of the model, 1/m_modelScale of the input
     int m_imgHeight;
     int m_inputFrames;
-    vector<vector<PsoNN *> > m_pPsos; // in width x height
-    int refineNetsByCollectiveWisdom(const vector<double> & p, cv::Mat & out);
+    PsoModelStore m_store; // in width x height
+    PSO_MODEL_TYPE m_modelType;
+    PSO_KERNEL_MODE m_kernelMode;
+    PsoRowKernel m_rowKernel; // NULL: per pixel scalar path
+    PsoCompactRowKernel m_compactRowKernel; // the same for PSO_MODEL_COMPACT
+    long m_kernelMismatches;  // only counted in PSO_KERNEL_CHECK mode
+    ThreadPool m_threadPool;
+    int m_bandNum;
+    vector<long> m_bandMismatches; // this frame's per band, summed after the barrier
+    bool m_bStreaming;
+    // streaming buffers: per band, a rolling window of 3 rows and its first & last row
+    vector<double> m_rowWindows;
+    vector<double> m_bandEdgeRows;
+    // change gating
+    TileGate m_tileGate;
+    int m_gateTileSize;
+    int m_gateTolerance;
+    // reduced resolution
+    int m_modelScale;
+    ModelScaler m_scaler;
+    int processScaledFrame(const cv::Mat & in, cv::Mat & out);
+    int processFrame(const cv::Mat & in, cv::Mat & out);
+    int classifyRow(const int k, const unsigned char * in, const bool bFirstInput, double * p);
+    int classifySpan(const int k, const int colBegin, const int colEnd,
+                     const unsigned char * in, const bool bFirstInput, double * p);
+    void ageSkippedNeurons(const int rowBegin, const int rowEnd);
+    int classifyBand(const int band, const cv::Mat & in, vector<double> & p);
+    int refineBand(const int band, const vector<double> & p, cv::Mat & out);
+    void getBandRows(const int band, int & rowBegin, int & rowEnd);
+    int classifyBandEdges(const int band, const cv::Mat & in);
+    int streamBand(const int band, const cv::Mat & in, cv::Mat & out);
+    void allocRowBuffers();
+    int refineNetsByCollectiveWisdom(const vector<double> & p, cv::Mat & out,
+                                     const int rowBegin, const int rowEnd);
+    int refineRow(const double * pUp, const double * pCur, const double * pDown,
+                  const int k, unsigned char * out);
+    int refineSpan(const double * pUp, const double * pCur, const double * pDown,
+                   const int k, const int colBegin, const int colEnd, unsigned char * out);
     const double M_COLLECTIVE_WISDOM_THREATHOLD = 0.6;
 };
 
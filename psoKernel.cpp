@@ -0,0 +1,522 @@
+#include <string.h>
+#include "vectorSpace.h"
+#include "psoKernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PSO_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace Vector_Space;
+
+namespace Seg_Three
+{
+//////////////////////////////////////////////////////////////////////////////////////////
+//// scalar kernel: the same per pixel computation as PsoNN::processOneInput
+void psoClassifyRowScalar(const unsigned char * in,
+                          const double * const * bg, const double * const * moving,
+                          const int width, double * p)
+{
+    for (int j = 0; j < width; j++)
+    {
+        const VectorSpace<double, 3> x((double)in[j*3], (double)in[j*3+1], (double)in[j*3+2]);
+        const VectorSpace<double, 3> wb(bg[0][j], bg[1][j], bg[2][j]);
+        const VectorSpace<double, 3> wm(moving[0][j], moving[1][j], moving[2][j]);
+        const double bgProbability =
+            distanceToProbability(VectorSpace<double, 3>::rgbEulerDistance(wb, x));
+        const double movingProbability =
+            distanceToProbability(VectorSpace<double, 3>::rgbEulerDistance(wm, x));
+        p[j] = movingProbability > bgProbability ? (1 - movingProbability) : bgProbability;
+    }
+}
+
+void psoClassifyRowGrayScalar(const unsigned char * in,
+                              const double * const * bg, const double * const * moving,
+                              const int width, double * p)
+{
+    for (int j = 0; j < width; j++)
+    {
+        const double bgProbability = distanceToProbability(grayEulerDistance(bg[0][j], in[j]));
+        const double movingProbability =
+            distanceToProbability(grayEulerDistance(moving[0][j], in[j]));
+        p[j] = movingProbability > bgProbability ? (1 - movingProbability) : bgProbability;
+    }
+}
+
+#ifdef PSO_KERNEL_X86
+namespace
+{
+// byte shuffles to split 8 BGR pixels (24 bytes, loaded as [0,16) & [8,24)) into three
+// channels, each in the low 8 bytes.
+const signed char M_SPLIT_LO[3][16] =
+{
+    {0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}
+};
+const signed char M_SPLIT_HI[3][16] =
+{
+    {-1, -1, -1, -1, -1, -1, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1},
+    {-1, -1, -1, -1, -1, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1},
+    {-1, -1, -1, -1, -1, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1}
+};
+
+__attribute__((target("sse4.1")))
+inline void splitChannels8(const unsigned char * in, __m128i * channels)
+{
+    const __m128i lo = _mm_loadu_si128((const __m128i *)in);
+    const __m128i hi = _mm_loadu_si128((const __m128i *)(in + 8));
+    for (int c = 0; c < 3; c++)
+        channels[c] = _mm_or_si128(
+            _mm_shuffle_epi8(lo, _mm_loadu_si128((const __m128i *)M_SPLIT_LO[c])),
+            _mm_shuffle_epi8(hi, _mm_loadu_si128((const __m128i *)M_SPLIT_HI[c])));
+}
+
+//// AVX2: 4 pixels per double vector
+__attribute__((target("avx2")))
+inline __m256d rgbDistanceAvx2(const double * const * w, const int j, const __m256d * x)
+{
+    const __m256d w0 = _mm256_loadu_pd(w[0] + j);
+    const __m128i meanRed = _mm256_cvttpd_epi32(
+        _mm256_mul_pd(_mm256_add_pd(w0, x[0]), _mm256_set1_pd(0.5)));
+    const __m128i r = _mm256_cvttpd_epi32(_mm256_sub_pd(w0, x[0]));
+    const __m128i g = _mm256_cvttpd_epi32(_mm256_sub_pd(_mm256_loadu_pd(w[1] + j), x[1]));
+    const __m128i b = _mm256_cvttpd_epi32(_mm256_sub_pd(_mm256_loadu_pd(w[2] + j), x[2]));
+    return _mm256_sqrt_pd(_mm256_cvtepi32_pd(rgbSquaredDistanceLanes(meanRed, r, g, b)));
+}
+
+__attribute__((target("avx2")))
+inline __m256d distanceToProbabilityAvx2(const __m256d d)
+{
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d p1 = _mm256_sub_pd(one, _mm256_mul_pd(d, _mm256_set1_pd(0.005)));
+    const __m256d p2 = _mm256_sub_pd(one, _mm256_add_pd(_mm256_mul_pd(d, _mm256_set1_pd(0.001)),
+                                                        _mm256_set1_pd(0.4)));
+    const __m256d p3 = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(d, _mm256_set1_pd(0.0005)),
+                                                   _mm256_set1_pd(-1.0)),
+                                     _mm256_set1_pd(0.3));
+    __m256d p = _mm256_and_pd(_mm256_cmp_pd(d, _mm256_set1_pd(400), _CMP_LT_OQ), p3);
+    p = _mm256_blendv_pd(p, p2, _mm256_cmp_pd(d, _mm256_set1_pd(200), _CMP_LE_OQ));
+    return _mm256_blendv_pd(p, p1, _mm256_cmp_pd(d, _mm256_set1_pd(20), _CMP_LE_OQ));
+}
+
+// gray: 3 * |(int)(w - x)|
+__attribute__((target("avx2")))
+inline __m256d grayDistanceAvx2(const double * w, const __m256d x)
+{
+    const __m256d d = _mm256_round_pd(_mm256_sub_pd(_mm256_loadu_pd(w), x),
+                                      _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    return _mm256_mul_pd(_mm256_set1_pd(3.0), _mm256_andnot_pd(_mm256_set1_pd(-0.0), d));
+}
+
+//// SSE4: 2 pixels per double vector
+__attribute__((target("sse4.1")))
+inline __m128d rgbDistanceSse4(const double * const * w, const int j, const __m128d * x)
+{
+    const __m128d w0 = _mm_loadu_pd(w[0] + j);
+    const __m128i meanRed = _mm_cvttpd_epi32(_mm_mul_pd(_mm_add_pd(w0, x[0]), _mm_set1_pd(0.5)));
+    const __m128i r = _mm_cvttpd_epi32(_mm_sub_pd(w0, x[0]));
+    const __m128i g = _mm_cvttpd_epi32(_mm_sub_pd(_mm_loadu_pd(w[1] + j), x[1]));
+    const __m128i b = _mm_cvttpd_epi32(_mm_sub_pd(_mm_loadu_pd(w[2] + j), x[2]));
+    return _mm_sqrt_pd(_mm_cvtepi32_pd(rgbSquaredDistanceLanes(meanRed, r, g, b)));
+}
+
+__attribute__((target("sse4.1")))
+inline __m128d distanceToProbabilitySse4(const __m128d d)
+{
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d p1 = _mm_sub_pd(one, _mm_mul_pd(d, _mm_set1_pd(0.005)));
+    const __m128d p2 = _mm_sub_pd(one, _mm_add_pd(_mm_mul_pd(d, _mm_set1_pd(0.001)),
+                                                  _mm_set1_pd(0.4)));
+    const __m128d p3 = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(d, _mm_set1_pd(0.0005)),
+                                             _mm_set1_pd(-1.0)),
+                                  _mm_set1_pd(0.3));
+    __m128d p = _mm_and_pd(_mm_cmplt_pd(d, _mm_set1_pd(400)), p3);
+    p = _mm_blendv_pd(p, p2, _mm_cmple_pd(d, _mm_set1_pd(200)));
+    return _mm_blendv_pd(p, p1, _mm_cmple_pd(d, _mm_set1_pd(20)));
+}
+
+} // namespace
+
+__attribute__((target("avx2")))
+void psoClassifyRowAvx2(const unsigned char * in,
+                        const double * const * bg, const double * const * moving,
+                        const int width, double * p)
+{
+    const __m256d one = _mm256_set1_pd(1.0);
+    int j = 0;
+    for (/**/; j + 8 <= width; j += 8)
+    {
+        __m128i channels[3];
+        splitChannels8(in + j * 3, channels);
+        for (int s = 0; s < 8; s += 4)
+        {
+            __m256d x[3];
+            for (int c = 0; c < 3; c++)
+                x[c] = _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(
+                           s == 0 ? channels[c] : _mm_srli_si128(channels[c], 4)));
+            const __m256d bgP = distanceToProbabilityAvx2(rgbDistanceAvx2(bg, j + s, x));
+            const __m256d mvP = distanceToProbabilityAvx2(rgbDistanceAvx2(moving, j + s, x));
+            _mm256_storeu_pd(p + j + s, _mm256_blendv_pd(bgP, _mm256_sub_pd(one, mvP),
+                                                         _mm256_cmp_pd(mvP, bgP, _CMP_GT_OQ)));
+        }
+    }
+
+    if (j < width) // tail
+    {
+        const double * bgTail[3] = {bg[0] + j, bg[1] + j, bg[2] + j};
+        const double * mvTail[3] = {moving[0] + j, moving[1] + j, moving[2] + j};
+        psoClassifyRowScalar(in + j * 3, bgTail, mvTail, width - j, p + j);
+    }
+}
+
+__attribute__((target("avx2")))
+void psoClassifyRowGrayAvx2(const unsigned char * in,
+                            const double * const * bg, const double * const * moving,
+                            const int width, double * p)
+{
+    const __m256d one = _mm256_set1_pd(1.0);
+    int j = 0;
+    for (/**/; j + 4 <= width; j += 4)
+    {
+        int fourPixels = 0;
+        memcpy(&fourPixels, in + j, sizeof(fourPixels));
+        const __m256d x = _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(fourPixels)));
+        const __m256d bgP = distanceToProbabilityAvx2(grayDistanceAvx2(bg[0] + j, x));
+        const __m256d mvP = distanceToProbabilityAvx2(grayDistanceAvx2(moving[0] + j, x));
+        _mm256_storeu_pd(p + j, _mm256_blendv_pd(bgP, _mm256_sub_pd(one, mvP),
+                                                 _mm256_cmp_pd(mvP, bgP, _CMP_GT_OQ)));
+    }
+
+    if (j < width) // tail
+    {
+        const double * bgTail[1] = {bg[0] + j};
+        const double * mvTail[1] = {moving[0] + j};
+        psoClassifyRowGrayScalar(in + j, bgTail, mvTail, width - j, p + j);
+    }
+}
+
+__attribute__((target("sse4.1")))
+void psoClassifyRowSse4(const unsigned char * in,
+                        const double * const * bg, const double * const * moving,
+                        const int width, double * p)
+{
+    const __m128d one = _mm_set1_pd(1.0);
+    int j = 0;
+    for (/**/; j + 8 <= width; j += 8)
+    {
+        __m128i channels[3];
+        splitChannels8(in + j * 3, channels);
+        for (int s = 0; s < 8; s += 2)
+        {
+            __m128d x[3];
+            for (int c = 0; c < 3; c++)
+            {
+                channels[c] = s == 0 ? channels[c] : _mm_srli_si128(channels[c], 2);
+                x[c] = _mm_cvtepi32_pd(_mm_cvtepu8_epi32(channels[c]));
+            }
+            const __m128d bgP = distanceToProbabilitySse4(rgbDistanceSse4(bg, j + s, x));
+            const __m128d mvP = distanceToProbabilitySse4(rgbDistanceSse4(moving, j + s, x));
+            _mm_storeu_pd(p + j + s, _mm_blendv_pd(bgP, _mm_sub_pd(one, mvP),
+                                                   _mm_cmpgt_pd(mvP, bgP)));
+        }
+    }
+
+    if (j < width) // tail
+    {
+        const double * bgTail[3] = {bg[0] + j, bg[1] + j, bg[2] + j};
+        const double * mvTail[3] = {moving[0] + j, moving[1] + j, moving[2] + j};
+        psoClassifyRowScalar(in + j * 3, bgTail, mvTail, width - j, p + j);
+    }
+}
+
+#else // no x86 SIMD, fall back to scalar
+void psoClassifyRowAvx2(const unsigned char * in,
+                        const double * const * bg, const double * const * moving,
+                        const int width, double * p)
+{
+    psoClassifyRowScalar(in, bg, moving, width, p);
+}
+
+void psoClassifyRowSse4(const unsigned char * in,
+                        const double * const * bg, const double * const * moving,
+                        const int width, double * p)
+{
+    psoClassifyRowScalar(in, bg, moving, width, p);
+}
+
+void psoClassifyRowGrayAvx2(const unsigned char * in,
+                            const double * const * bg, const double * const * moving,
+                            const int width, double * p)
+{
+    psoClassifyRowGrayScalar(in, bg, moving, width, p);
+}
+#endif // PSO_KERNEL_X86
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//// compact model's probability table & row kernels
+namespace
+{
+vector<float> buildPsoProbabilityLut()
+{
+    vector<float> lut(PSO_PROBABILITY_LUT_SIZE + 1, 0.0f);
+    for (int k = 0; k < PSO_PROBABILITY_LUT_SIZE; k++)
+        lut[k] = (float)distanceToProbability((double)k);
+    return lut;
+}
+} // namespace
+
+const float * getPsoProbabilityLut()
+{
+    static const vector<float> lut = buildPsoProbabilityLut();
+    return &lut[0];
+}
+
+void psoClassifyRowCompactScalar(const unsigned char * in,
+                                 const unsigned short * const * bg,
+                                 const unsigned short * const * moving,
+                                 const int width, double * p)
+{
+    static const float * lut = getPsoProbabilityLut();
+    for (int j = 0; j < width; j++)
+    {
+        const unsigned short wb[3] = {bg[0][j], bg[1][j], bg[2][j]};
+        const unsigned short wm[3] = {moving[0][j], moving[1][j], moving[2][j]};
+        const double bgProbability =
+            squaredDistanceToProbability(lut, rgbSquaredDistanceFixed(wb, in + j*3));
+        const double movingProbability =
+            squaredDistanceToProbability(lut, rgbSquaredDistanceFixed(wm, in + j*3));
+        p[j] = movingProbability > bgProbability ? (1 - movingProbability) : bgProbability;
+    }
+}
+
+void psoClassifyRowCompactGrayScalar(const unsigned char * in,
+                                     const unsigned short * const * bg,
+                                     const unsigned short * const * moving,
+                                     const int width, double * p)
+{
+    static const float * lut = getPsoProbabilityLut();
+    for (int j = 0; j < width; j++)
+    {
+        const double bgProbability =
+            squaredDistanceToProbability(lut, graySquaredDistanceFixed(bg[0][j], in[j]));
+        const double movingProbability =
+            squaredDistanceToProbability(lut, graySquaredDistanceFixed(moving[0][j], in[j]));
+        p[j] = movingProbability > bgProbability ? (1 - movingProbability) : bgProbability;
+    }
+}
+
+#ifdef PSO_KERNEL_X86
+namespace
+{
+//// AVX2 integer: 8 pixels per int32 vector, x is the input << PSO_FIXED_SHIFT
+// |fixedToInt(w - x)| of 8 weights; the sign doesn't matter, the difference is squared.
+__attribute__((target("avx2")))
+inline __m256i fixedAbsDiffAvx2(const __m256i w, const __m256i x)
+{
+    return _mm256_srli_epi32(_mm256_abs_epi32(_mm256_sub_epi32(w, x)), PSO_FIXED_SHIFT);
+}
+
+__attribute__((target("avx2")))
+inline __m256i loadWeights8(const unsigned short * w)
+{
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)w));
+}
+
+// rgbSquaredDistanceFixed
+__attribute__((target("avx2")))
+inline __m256i rgbSquaredDistanceFixedAvx2(const unsigned short * const * w, const int j,
+                                           const __m256i * x)
+{
+    const __m256i w0 = loadWeights8(w[0] + j);
+    const __m256i meanRed = _mm256_srli_epi32(_mm256_add_epi32(w0, x[0]), PSO_FIXED_SHIFT + 1);
+    const __m256i r = fixedAbsDiffAvx2(w0, x[0]);
+    const __m256i g = fixedAbsDiffAvx2(loadWeights8(w[1] + j), x[1]);
+    const __m256i b = fixedAbsDiffAvx2(loadWeights8(w[2] + j), x[2]);
+    const __m256i rr = _mm256_srli_epi32(_mm256_mullo_epi32(
+        _mm256_add_epi32(meanRed, _mm256_set1_epi32(512)), _mm256_mullo_epi32(r, r)), 8);
+    const __m256i gg = _mm256_slli_epi32(_mm256_mullo_epi32(g, g), 2);
+    const __m256i bb = _mm256_srli_epi32(_mm256_mullo_epi32(
+        _mm256_sub_epi32(_mm256_set1_epi32(767), meanRed), _mm256_mullo_epi32(b, b)), 8);
+    return _mm256_add_epi32(_mm256_add_epi32(rr, gg), bb);
+}
+
+// graySquaredDistanceFixed
+__attribute__((target("avx2")))
+inline __m256i graySquaredDistanceFixedAvx2(const unsigned short * w, const __m256i x)
+{
+    const __m256i d = fixedAbsDiffAvx2(loadWeights8(w), x);
+    return _mm256_mullo_epi32(_mm256_mullo_epi32(d, d), _mm256_set1_epi32(9));
+}
+
+// squaredDistanceToProbability
+__attribute__((target("avx2")))
+inline __m256 squaredToProbabilityAvx2(const float * lut, const __m256i squared)
+{
+    const __m256i distance = _mm256_min_epi32(
+        _mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(squared))),
+        _mm256_set1_epi32(PSO_PROBABILITY_LUT_SIZE));
+    return _mm256_i32gather_ps(lut, distance, 4);
+}
+
+// p of 8 pixels, in doubles like the scalar path
+__attribute__((target("avx2")))
+inline void storeProbabilities8(const __m256 bgP, const __m256 mvP, double * p)
+{
+    const __m256d one = _mm256_set1_pd(1.0);
+    for (int s = 0; s < 2; s++)
+    {
+        const __m256d bg = _mm256_cvtps_pd(s == 0 ? _mm256_castps256_ps128(bgP) :
+                                                    _mm256_extractf128_ps(bgP, 1));
+        const __m256d mv = _mm256_cvtps_pd(s == 0 ? _mm256_castps256_ps128(mvP) :
+                                                    _mm256_extractf128_ps(mvP, 1));
+        _mm256_storeu_pd(p + s * 4, _mm256_blendv_pd(bg, _mm256_sub_pd(one, mv),
+                                                     _mm256_cmp_pd(mv, bg, _CMP_GT_OQ)));
+    }
+}
+} // namespace
+
+__attribute__((target("avx2")))
+void psoClassifyRowCompactAvx2(const unsigned char * in,
+                               const unsigned short * const * bg,
+                               const unsigned short * const * moving,
+                               const int width, double * p)
+{
+    static const float * lut = getPsoProbabilityLut();
+    int j = 0;
+    for (/**/; j + 8 <= width; j += 8)
+    {
+        __m128i channels[3];
+        splitChannels8(in + j * 3, channels);
+        __m256i x[3];
+        for (int c = 0; c < 3; c++)
+            x[c] = _mm256_slli_epi32(_mm256_cvtepu8_epi32(channels[c]), PSO_FIXED_SHIFT);
+        const __m256i bgSquared = rgbSquaredDistanceFixedAvx2(bg, j, x);
+        const __m256i mvSquared = rgbSquaredDistanceFixedAvx2(moving, j, x);
+        const __m256 bgP = squaredToProbabilityAvx2(lut, bgSquared);
+        const __m256 mvP = squaredToProbabilityAvx2(lut, mvSquared);
+        storeProbabilities8(bgP, mvP, p + j);
+    }
+
+    if (j < width) // tail
+    {
+        const unsigned short * bgTail[3] = {bg[0] + j, bg[1] + j, bg[2] + j};
+        const unsigned short * mvTail[3] = {moving[0] + j, moving[1] + j, moving[2] + j};
+        psoClassifyRowCompactScalar(in + j * 3, bgTail, mvTail, width - j, p + j);
+    }
+}
+
+__attribute__((target("avx2")))
+void psoClassifyRowCompactGrayAvx2(const unsigned char * in,
+                                   const unsigned short * const * bg,
+                                   const unsigned short * const * moving,
+                                   const int width, double * p)
+{
+    static const float * lut = getPsoProbabilityLut();
+    int j = 0;
+    for (/**/; j + 8 <= width; j += 8)
+    {
+        const __m128i eightPixels = _mm_loadl_epi64((const __m128i *)(in + j));
+        const __m256i x = _mm256_slli_epi32(_mm256_cvtepu8_epi32(eightPixels),
+                                            PSO_FIXED_SHIFT);
+        const __m256i bgSquared = graySquaredDistanceFixedAvx2(bg[0] + j, x);
+        const __m256i mvSquared = graySquaredDistanceFixedAvx2(moving[0] + j, x);
+        const __m256 bgP = squaredToProbabilityAvx2(lut, bgSquared);
+        const __m256 mvP = squaredToProbabilityAvx2(lut, mvSquared);
+        storeProbabilities8(bgP, mvP, p + j);
+    }
+
+    if (j < width) // tail
+    {
+        const unsigned short * bgTail[1] = {bg[0] + j};
+        const unsigned short * mvTail[1] = {moving[0] + j};
+        psoClassifyRowCompactGrayScalar(in + j, bgTail, mvTail, width - j, p + j);
+    }
+}
+
+#else // no x86 SIMD, fall back to scalar
+void psoClassifyRowCompactAvx2(const unsigned char * in,
+                               const unsigned short * const * bg,
+                               const unsigned short * const * moving,
+                               const int width, double * p)
+{
+    psoClassifyRowCompactScalar(in, bg, moving, width, p);
+}
+
+void psoClassifyRowCompactGrayAvx2(const unsigned char * in,
+                                   const unsigned short * const * bg,
+                                   const unsigned short * const * moving,
+                                   const int width, double * p)
+{
+    psoClassifyRowCompactGrayScalar(in, bg, moving, width, p);
+}
+#endif // PSO_KERNEL_X86
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//// runtime dispatch
+PsoRowKernel selectPsoRowKernel(const PSO_KERNEL_MODE mode)
+{
+#ifdef PSO_KERNEL_X86
+    const bool bAvx2 = __builtin_cpu_supports("avx2");
+    const bool bSse4 = __builtin_cpu_supports("sse4.1");
+#else
+    const bool bAvx2 = false;
+    const bool bSse4 = false;
+#endif
+    switch (mode)
+    {
+    case PSO_KERNEL_SCALAR:
+        return NULL;
+    case PSO_KERNEL_SSE4:
+        return bSse4 ? psoClassifyRowSse4 : NULL;
+    case PSO_KERNEL_AVX2:
+        return bAvx2 ? psoClassifyRowAvx2 : NULL;
+    case PSO_KERNEL_AUTO:
+    case PSO_KERNEL_CHECK:
+    default:
+        if (bAvx2)
+            return psoClassifyRowAvx2;
+        return bSse4 ? psoClassifyRowSse4 : NULL;
+    }
+}
+
+PsoRowKernel selectPsoGrayRowKernel(const PSO_KERNEL_MODE mode)
+{
+    if (mode == PSO_KERNEL_SCALAR)
+        return NULL;
+    // no SSE4 gray kernel, the scalar one is the SSE4 fallback
+    return selectPsoRowKernel(mode) == psoClassifyRowAvx2 ? psoClassifyRowGrayAvx2 :
+                                                            psoClassifyRowGrayScalar;
+}
+
+PsoCompactRowKernel selectPsoCompactRowKernel(const PSO_KERNEL_MODE mode,
+                                              const int channels)
+{
+    if (mode == PSO_KERNEL_SCALAR)
+        return NULL;
+    // no SSE4 integer kernel, the scalar row one is the SSE4 fallback
+    const bool bAvx2 = selectPsoRowKernel(mode) == psoClassifyRowAvx2;
+    if (channels == 1)
+        return bAvx2 ? psoClassifyRowCompactGrayAvx2 : psoClassifyRowCompactGrayScalar;
+    return bAvx2 ? psoClassifyRowCompactAvx2 : psoClassifyRowCompactScalar;
+}
+
+const char * getPsoKernelStr(const PsoRowKernel kernel)
+{
+    if (kernel == psoClassifyRowAvx2 || kernel == psoClassifyRowGrayAvx2)
+        return "AVX2";
+    else if (kernel == psoClassifyRowSse4)
+        return "SSE4";
+    return "Scalar";
+}
+
+const char * getPsoCompactKernelStr(const PsoCompactRowKernel kernel)
+{
+    if (kernel == psoClassifyRowCompactAvx2 || kernel == psoClassifyRowCompactGrayAvx2)
+        return "AVX2i";
+    else if (kernel != NULL)
+        return "Integer";
+    return "Scalar";
+}
+
+} // namespace Seg_Three
@@ -0,0 +1,143 @@
+#ifndef _PSO_KERNEL_H_
+#define _PSO_KERNEL_H_
+
+// sys
+#include <stdio.h>
+#include <math.h>
+
+namespace Seg_Three
+{
+//////////////////////////////////////////////////////////////////////////////////////////
+//// Row kernels of PsoBook's classification: for one row of BGR pixels, compute both rgb
+//// distances (to the bg & moving weights in the planar store) and map them to the
+//// background probability. SIMD versions must be bit exact with the scalar one.
+enum PSO_KERNEL_MODE
+{
+    PSO_KERNEL_AUTO = 0, // best kernel the cpu supports
+    PSO_KERNEL_SCALAR,   // the per pixel PsoNN path
+    PSO_KERNEL_SSE4,
+    PSO_KERNEL_AVX2,
+    PSO_KERNEL_CHECK     // AUTO, and compare every row against the scalar path
+};
+
+// bg/moving: one weight plane per channel, already offset to the row start.
+typedef void (*PsoRowKernel)(const unsigned char * in,
+                             const double * const * bg, const double * const * moving,
+                             const int width, double * p);
+
+extern void psoClassifyRowScalar(const unsigned char * in,
+                                 const double * const * bg, const double * const * moving,
+                                 const int width, double * p);
+extern void psoClassifyRowSse4(const unsigned char * in,
+                               const double * const * bg, const double * const * moving,
+                               const int width, double * p);
+extern void psoClassifyRowAvx2(const unsigned char * in,
+                               const double * const * bg, const double * const * moving,
+                               const int width, double * p);
+// one gray channel: only bg[0] & moving[0] are used.
+extern void psoClassifyRowGrayScalar(const unsigned char * in,
+                                     const double * const * bg, const double * const * moving,
+                                     const int width, double * p);
+extern void psoClassifyRowGrayAvx2(const unsigned char * in,
+                                   const double * const * bg, const double * const * moving,
+                                   const int width, double * p);
+// returns NULL for PSO_KERNEL_SCALAR, or if the wanted SIMD is not supported.
+extern PsoRowKernel selectPsoRowKernel(const PSO_KERNEL_MODE mode);
+extern PsoRowKernel selectPsoGrayRowKernel(const PSO_KERNEL_MODE mode);
+extern const char * getPsoKernelStr(const PsoRowKernel kernel);
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//// Compact model (8.8 fixed point weights): the squared rgbEulerDistance in integers, and
+//// the probability looked up by its whole distance, so no floating point distance and a
+//// table small enough for L1.
+enum {PSO_FIXED_SHIFT = 8};
+enum {PSO_PROBABILITY_LUT_SIZE = 400}; // distanceToProbability is 0 from 400 on
+
+inline int fixedToInt(const int v)
+{
+    return v >= 0 ? (v >> PSO_FIXED_SHIFT) : -((-v) >> PSO_FIXED_SHIFT);
+}
+
+inline int rgbSquaredDistanceFixed(const unsigned short * w, const unsigned char * x)
+{
+    const int meanRed = (w[0] + (x[0] << PSO_FIXED_SHIFT)) >> (PSO_FIXED_SHIFT + 1);
+    const int r = fixedToInt(w[0] - (x[0] << PSO_FIXED_SHIFT));
+    const int g = fixedToInt(w[1] - (x[1] << PSO_FIXED_SHIFT));
+    const int b = fixedToInt(w[2] - (x[2] << PSO_FIXED_SHIFT));
+    return (((512 + meanRed)*r*r)>>8) + 4*g*g + (((767-meanRed)*b*b)>>8);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//// Gray distance: scaled by 3, so the same change on all three channels is about as far
+//// as with rgbEulerDistance (sqrt((512 + 4*256 + 767) / 256) ~= 3), and the rgb
+//// distance -> probability mapping is kept.
+inline double grayEulerDistance(const double w, const double x)
+{
+    const int d = w - x;
+    return 3.0 * (d >= 0 ? d : -d);
+}
+
+inline int graySquaredDistanceFixed(const unsigned short w, const unsigned char x)
+{
+    const int d = fixedToInt(w - (x << PSO_FIXED_SHIFT));
+    return 9 * d * d;
+}
+
+// the whole distance of a squared one, at most PSO_PROBABILITY_LUT_SIZE. The float sqrt is
+// exact enough for it: squared < 2^24 converts exactly, and sqrt is correctly rounded.
+inline int squaredToDistance(const int squared)
+{
+    const int distance = (int)sqrtf((float)squared);
+    return distance < PSO_PROBABILITY_LUT_SIZE ? distance : PSO_PROBABILITY_LUT_SIZE;
+}
+
+// shared by all PsoBooks: PSO_PROBABILITY_LUT_SIZE + 1 entries, the last one is 0.
+extern const float * getPsoProbabilityLut();
+inline double squaredDistanceToProbability(const float * lut, const int squaredDistance)
+{
+    return lut[squaredToDistance(squaredDistance)];
+}
+
+// one row of the compact model, weight planes already offset to the row start. Integer
+// SIMD versions must be bit exact with the scalar ones.
+typedef void (*PsoCompactRowKernel)(const unsigned char * in,
+                                    const unsigned short * const * bg,
+                                    const unsigned short * const * moving,
+                                    const int width, double * p);
+
+extern void psoClassifyRowCompactScalar(const unsigned char * in,
+                                        const unsigned short * const * bg,
+                                        const unsigned short * const * moving,
+                                        const int width, double * p);
+extern void psoClassifyRowCompactAvx2(const unsigned char * in,
+                                      const unsigned short * const * bg,
+                                      const unsigned short * const * moving,
+                                      const int width, double * p);
+extern void psoClassifyRowCompactGrayScalar(const unsigned char * in,
+                                            const unsigned short * const * bg,
+                                            const unsigned short * const * moving,
+                                            const int width, double * p);
+extern void psoClassifyRowCompactGrayAvx2(const unsigned char * in,
+                                          const unsigned short * const * bg,
+                                          const unsigned short * const * moving,
+                                          const int width, double * p);
+// returns NULL for PSO_KERNEL_SCALAR; the scalar row kernel without AVX2.
+extern PsoCompactRowKernel selectPsoCompactRowKernel(const PSO_KERNEL_MODE mode,
+                                                     const int channels);
+extern const char * getPsoCompactKernelStr(const PsoCompactRowKernel kernel);
+
+inline double distanceToProbability(const double distance)
+{
+    if (distance <= 20)
+        return 1.0 - distance * 0.005;
+    else if (distance <= 200)
+        return 1.0 - (distance * 0.001 + 0.4);
+    else if (distance < 400)
+        return distance * 0.0005 * (-1.0) + 0.3;
+    else
+        return 0.0;
+}
+
+} // namespace Seg_Three
+
+#endif // _PSO_KERNEL_H_
@@ -0,0 +1,168 @@
+// sys
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+// project
+#include "segSnapshot.h"
+
+namespace Seg_Three
+{
+namespace
+{
+const char SNAPSHOT_MAGIC[8] = {'S', 'E', 'G', 'S', 'N', 'A', 'P', '\0'};
+
+// make the rename durable too
+void syncParentDir(const string & path)
+{
+    vector<char> pathCopy(path.begin(), path.end());
+    pathCopy.push_back('\0');
+    const int fd = ::open(dirname(&pathCopy[0]), O_RDONLY);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+    return;
+}
+} // namespace
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+//// SnapshotWriter
+SnapshotWriter :: ~SnapshotWriter()
+{
+    if (m_pFile != NULL)
+    {   // not committed: drop the partial file
+        fclose(m_pFile);
+        unlink(m_tmpPath.c_str());
+    }
+    return;
+}
+
+int SnapshotWriter :: open(const string & path, const SnapshotHeader & header)
+{
+    if (m_pFile != NULL)
+        return -1;
+    m_path = path;
+    m_tmpPath = path + ".tmp";
+    m_pFile = fopen(m_tmpPath.c_str(), "wb");
+    if (m_pFile == NULL)
+    {
+        LogE("Can not create snapshot %s: %s.\n", m_tmpPath.c_str(), strerror(errno));
+        return -1;
+    }
+    m_header = header;
+    memcpy(m_header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    m_header.headerBytes = sizeof(SnapshotHeader);
+    m_header.payloadBytes = 0;
+    m_payloadBytes = 0;
+    return fwrite(&m_header, sizeof(m_header), 1, m_pFile) == 1 ? 0 : -1;
+}
+
+int SnapshotWriter :: write(const void * data, const size_t bytes)
+{
+    if (m_pFile == NULL || fwrite(data, 1, bytes, m_pFile) != bytes)
+        return -1;
+    m_payloadBytes += bytes;
+    return 0;
+}
+
+int SnapshotWriter :: commit()
+{
+    if (m_pFile == NULL)
+        return -1;
+    m_header.payloadBytes = m_payloadBytes;
+    bool bOk = fseek(m_pFile, 0, SEEK_SET) == 0 &&
+               fwrite(&m_header, sizeof(m_header), 1, m_pFile) == 1 &&
+               fflush(m_pFile) == 0 &&
+               fsync(fileno(m_pFile)) == 0;
+    bOk = (fclose(m_pFile) == 0) && bOk;
+    m_pFile = NULL;
+    if (bOk == false || rename(m_tmpPath.c_str(), m_path.c_str()) != 0)
+    {
+        LogE("Write snapshot %s failed: %s.\n", m_path.c_str(), strerror(errno));
+        unlink(m_tmpPath.c_str());
+        return -1;
+    }
+    syncParentDir(m_path);
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+//// SnapshotReader
+SnapshotReader :: ~SnapshotReader()
+{
+    if (m_pData != NULL)
+        munmap((void *)m_pData, m_bytes);
+    return;
+}
+
+int SnapshotReader :: open(const string & path, const SNAPSHOT_MODEL_KIND modelKind,
+                           const unsigned int version)
+{
+    if (m_pData != NULL)
+        return -1;
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        LogW("Can not open snapshot %s: %s.\n", path.c_str(), strerror(errno));
+        return -1;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < (off_t)sizeof(SnapshotHeader))
+    {
+        close(fd);
+        LogW("Snapshot %s is too small.\n", path.c_str());
+        return -1;
+    }
+    void * pMap = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pMap == MAP_FAILED)
+    {
+        LogW("Can not map snapshot %s: %s.\n", path.c_str(), strerror(errno));
+        return -1;
+    }
+    m_pData = (const unsigned char *)pMap;
+    m_bytes = fileStat.st_size;
+    m_offset = sizeof(SnapshotHeader);
+
+    const SnapshotHeader & h = header();
+    if (memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        h.headerBytes != sizeof(SnapshotHeader) ||
+        h.payloadBytes != m_bytes - sizeof(SnapshotHeader))
+    {
+        LogW("Snapshot %s is not a valid snapshot.\n", path.c_str());
+        return -1;
+    }
+    if (h.modelKind != (unsigned int)modelKind || h.version != version)
+    {
+        LogW("Snapshot %s is model %u version %u, want model %u version %u.\n",
+             path.c_str(), h.modelKind, h.version, (unsigned int)modelKind, version);
+        return -1;
+    }
+    return 0;
+}
+
+const void * SnapshotReader :: read(const size_t bytes)
+{
+    if (m_pData == NULL || bytes > m_bytes - m_offset)
+        return NULL;
+    const void * p = m_pData + m_offset;
+    m_offset += bytes;
+    return p;
+}
+
+int SnapshotReader :: read(void * data, const size_t bytes)
+{
+    const void * p = read(bytes);
+    if (p == NULL)
+        return -1;
+    memcpy(data, p, bytes);
+    return 0;
+}
+
+} // namespace Seg_Three
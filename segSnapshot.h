@@ -0,0 +1,98 @@
+#ifndef _SEG_SNAPSHOT_H_
+#define _SEG_SNAPSHOT_H_
+
+// sys
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+// project
+#include "segUtil.h"
+
+// namespace
+using :: std :: string;
+using :: std :: vector;
+
+namespace Seg_Three
+{
+//////////////////////////////////////////////////////////////////////////////////////////
+//// Binary snapshot of a learned background model, so a restarted process resumes with a
+//// warm background instead of converging from an empty one.
+//   file: SnapshotHeader | payload (model specific, raw little endian planes/fields)
+// 1. written to 'path.tmp', fsync'ed, then renamed over 'path': readers never see a
+//    partial file.
+// 2. read through mmap; the model copies what it needs out of the mapping.
+enum SNAPSHOT_MODEL_KIND
+{
+    SNAPSHOT_PSO_BOOK = 1,
+    SNAPSHOT_ART_SEGMENT = 2
+};
+
+struct SnapshotHeader
+{
+    char magic[8];               // SNAPSHOT_MAGIC
+    unsigned int headerBytes;    // sizeof(SnapshotHeader) of the writer
+    unsigned int modelKind;      // SNAPSHOT_MODEL_KIND
+    unsigned int version;        // payload format version of that model kind
+    unsigned int modelType;      // model specific, e.g. PSO_MODEL_TYPE
+    int width;
+    int height;
+    int channels;
+    int inputFrames;
+    unsigned long long payloadBytes;
+};
+
+class SnapshotWriter
+{
+public:
+    SnapshotWriter() : m_pFile(NULL), m_payloadBytes(0) {}
+    ~SnapshotWriter();
+    int open(const string & path, const SnapshotHeader & header);
+    int write(const void * data, const size_t bytes);
+    template <typename T>
+    int writeVector(const vector<T> & v)
+    {
+        return v.size() > 0 ? write(&v[0], v.size() * sizeof(T)) : 0;
+    }
+    template <typename T>
+    int writeValue(const T & value) {return write(&value, sizeof(T));}
+    // patch the header, fsync and rename into place; without it the tmp file is dropped.
+    int commit();
+
+private:
+    FILE * m_pFile;
+    string m_path;
+    string m_tmpPath;
+    SnapshotHeader m_header;
+    unsigned long long m_payloadBytes;
+};
+
+class SnapshotReader
+{
+public:
+    SnapshotReader() : m_pData(NULL), m_bytes(0), m_offset(0) {}
+    ~SnapshotReader();
+    // map the file & check magic, model kind, version and sizes.
+    int open(const string & path, const SNAPSHOT_MODEL_KIND modelKind,
+             const unsigned int version);
+    const SnapshotHeader & header() const {return *(const SnapshotHeader *)m_pData;}
+    // pointer into the mapping, NULL if there are not that many bytes left.
+    const void * read(const size_t bytes);
+    int read(void * data, const size_t bytes);
+    template <typename T>
+    int readVector(vector<T> & v)
+    {
+        return v.size() > 0 ? read(&v[0], v.size() * sizeof(T)) : 0;
+    }
+    template <typename T>
+    int readValue(T & value) {return read(&value, sizeof(T));}
+
+private:
+    const unsigned char * m_pData;
+    size_t m_bytes;
+    size_t m_offset;
+};
+
+} // namespace Seg_Three
+
+#endif // _SEG_SNAPSHOT_H_
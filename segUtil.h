@@ -15,11 +15,17 @@ namespace Seg_Three
 {
 //////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////    
-//// Log Macros: Minimal Log Facility
+//// Log Macros: Minimal Log Facility. SEG_QUIET_LOG compiles the debug & info logs out,
+//// for the benches: the per line / frame printf would be what they measure.
+#ifdef SEG_QUIET_LOG
+#define LogD(format, ...)
+#define LogI(format, ...)
+#else
 #define LogD(format, ...)  printf("[%-8s:%4d] [DEBUG] " format, \
                                    __FUNCTION__, __LINE__, ##__VA_ARGS__)
 #define LogI(format, ...)  printf("[%-8s:%4d] [INFO] " format, \
                                    __FUNCTION__, __LINE__, ##__VA_ARGS__)
+#endif
 #define LogW(format, ...)  printf("[%-8s:%4d] [WARN] " format, \
                                    __FILE__, __LINE__, ##__VA_ARGS__)
 #define LogE(format, ...)  printf("[%-8s:%4d] [ERROR] " format, \
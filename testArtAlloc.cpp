@@ -0,0 +1,116 @@
+// sys
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+// tools
+#include <opencv2/core/core.hpp>
+#include <boost/atomic.hpp>
+// project
+#include "artsegment.h"
+
+// namespaces
+using namespace cv;
+using namespace Art_Segment;
+
+///////////////////// Code ///////////////////////////////////////////////////////////////
+// every heap allocation of the process goes through here
+namespace
+{
+boost::atomic<long> g_allocations(0);
+} // namespace
+
+void * operator new(size_t bytes)
+{
+    g_allocations++;
+    void * p = malloc(bytes > 0 ? bytes : 1);
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void * operator new[](size_t bytes)
+{
+    return operator new(bytes);
+}
+
+void operator delete(void * p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void * p) noexcept
+{
+    free(p);
+}
+
+namespace
+{
+
+#define ALLOC_WARMUP_FRAMES (50)
+#define ALLOC_TEST_FRAMES (100)
+
+// textured static background with sensor noise and a moving box
+void makeFrame(Mat & frame, const int width, const int height, const int frameNo)
+{
+    const int boxX = (frameNo * 4) % width;
+    const int boxY = height / 3;
+    for (int k = 0; k < height; k++)
+    {
+        unsigned char * row = frame.ptr<unsigned char>(k);
+        for (int j = 0; j < width; j++)
+        {
+            const bool bBox = j >= boxX && j < boxX + width / 8 &&
+                              k >= boxY && k < boxY + height / 6;
+            for (int c = 0; c < 3; c++)
+            {
+                const int bg = ((j * 3 + k * 5 + c * 40) & 0xFF) + rand() % 7 - 3;
+                const int v = bBox ? 230 - c * 70 : bg;
+                row[j * 3 + c] = (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+            }
+        }
+    }
+    return;
+}
+
+// heap allocations per frame once the neurons are warm; the frames are made up front.
+double countAllocationsPerFrame(ArtSegment & asn, const int width, const int height)
+{
+    vector<Mat> frames(16);
+    for (int k = 0; k < (int)frames.size(); k++)
+    {
+        frames[k].create(height, width, CV_8UC3);
+        makeFrame(frames[k], width, height, k);
+    }
+    Mat binaryFrame(height, width, CV_8UC1);
+    for (int k = 0; k < ALLOC_WARMUP_FRAMES; k++)
+        asn.processFrame(frames[k % frames.size()], binaryFrame);
+    const long before = g_allocations;
+    for (int k = 0; k < ALLOC_TEST_FRAMES; k++)
+        asn.processFrame(frames[k % frames.size()], binaryFrame);
+    return (double)(g_allocations - before) / ALLOC_TEST_FRAMES;
+}
+
+} // namespace
+
+///////////////////// Test ///////////////////////////////////////////////////////////////
+// usage: artalloc.out [width height]; fails if the steady state per pixel path allocates.
+int main(int argc, char * argv[])
+{
+    const int width = argc > 2 ? atoi(argv[1]) : 320;
+    const int height = argc > 2 ? atoi(argv[2]) : 240;
+    int failed = 0;
+    for (int setup = 0; setup < 4; setup++)
+    {
+        ArtSegment asn(width, height, setup == 3 ? 2 : 1);
+        if (setup == 1 || setup == 3)
+            asn.setThreadNum(4);
+        if (setup == 2)
+            asn.setChangeGating(16, 4);
+        const double allocations = countAllocationsPerFrame(asn, width, height);
+        printf("ArtSegment %dx%d %-19s: %.2f heap allocations/frame.\n", width, height,
+               setup == 0 ? "1 thread" : (setup == 1 ? "4 threads" :
+               (setup == 2 ? "gated 16/4" : "1/2 scale 4 threads")), allocations);
+        failed |= allocations > 0.0;
+    }
+    return failed;
+}
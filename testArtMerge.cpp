@@ -0,0 +1,118 @@
+// sys
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+// tools
+#include <opencv2/core/core.hpp>
+// project
+#include "artsegment.h"
+
+// namespaces
+using namespace cv;
+using namespace Art_Segment;
+
+///////////////////// Code ///////////////////////////////////////////////////////////////
+namespace
+{
+
+#define MERGE_TEST_FRAMES (480) // the black & green neurons meet after about 430
+
+// green of the drifting colour in its 'step'-th frame: one green level (distance 2) a
+// frame, which a neuron follows within its vigilance (20), & slower near black, where the
+// black neuron would win it if its own neuron lagged behind.
+int driftGreen(const int step)
+{
+    if (step < 235)
+        return 255 - step;
+    if (step < 235 + 16 * 4)
+        return 20 - (step - 235) / 4;
+    return std::max(1, 4 - (step - 235 - 16 * 4) / 20);
+}
+
+// a white background, which a black & a green neuron join (more than 500 apart, so each
+// fires its own); the green then drifts to black, until its neuron overlaps the black one.
+// After MERGE_TEST_FRAMES, magenta: far from all, so it fires a new neuron.
+ArtVector driftInput(const int frameNo)
+{
+    int step = 0; // drifting frames before this one
+    for (int n = 3; n < frameNo; n++)
+        step += n % 10 != 0;
+    if (frameNo >= MERGE_TEST_FRAMES)
+        return ArtVector(255.0, 0.0, 255.0);
+    if (frameNo == 0 || (frameNo > 2 && frameNo % 20 == 0))
+        return ArtVector(255.0, 255.0, 255.0);
+    if (frameNo == 2 || (frameNo > 2 && frameNo % 20 == 10))
+        return ArtVector(0.0, 0.0, 0.0);
+    return ArtVector(0.0, frameNo == 1 ? 255.0 : driftGreen(step), 0.0);
+}
+
+// one net with room for two neurons beyond its first: the green & black neurons must
+// merge, give their slot back to the budget, & the magenta one must take it without an
+// eviction; without merging the budget is full & magenta evicts. Returns the failures.
+int checkNetMerge(const bool bMerge)
+{
+    Neuron slots[ART_NEURON_SLOTS];
+    NeuronBudget budget;
+    budget.setExtraLimit(2);
+    ArtNN net(0, slots, ART_NEURON_SLOTS, &budget);
+    if (bMerge == false)
+        net.setMergePeriod(0);
+    for (int k = 0; k < MERGE_TEST_FRAMES; k++)
+        net.processOneInput(driftInput(k));
+    const int neurons = net.getBgNum() + net.getMovingNum();
+    const long extraNeurons = budget.getExtraNeurons();
+    net.processOneInput(driftInput(MERGE_TEST_FRAMES));
+    printf("ArtNN merge %-3s: %u merges, %d neurons, %ld of 2 extra; then %d neurons, %ld "
+           "extra, %u evictions.\n", bMerge ? "on" : "off", net.getMerges(), neurons,
+           extraNeurons, net.getBgNum() + net.getMovingNum(), budget.getExtraNeurons(),
+           net.getEvictions());
+    if (bMerge)
+        return (net.getMerges() != 1) + (neurons != 2) + (extraNeurons != 1) +
+               (net.getEvictions() != 0) + (budget.getExtraNeurons() != 2);
+    return (net.getMerges() != 0) + (neurons != 3) + (net.getEvictions() != 1);
+}
+
+// the same on all pixels of an ArtSegment whose budget is three neurons a pixel: a
+// merged pair's slot goes back to its tile's share, so magenta evicts nowhere.
+int checkSegmentMerge(const int width, const int height, const bool bMerge)
+{
+    ArtSegment asn(width, height);
+    asn.setNeuronBudget(ART_NEURON_SLOTS, (long)width * height * 3);
+    asn.setNeuronMergePeriod(bMerge ? ART_MERGE_PERIOD : 0);
+    Mat frame(height, width, CV_8UC3), mask(height, width, CV_8UC1);
+    ArtNeuronStats stats;
+    for (int k = 0; k <= MERGE_TEST_FRAMES; k++)
+    {
+        const ArtVector input = driftInput(k);
+        for (int i = 0; i < height; i++)
+        {
+            unsigned char * row = frame.ptr<unsigned char>(i);
+            for (int j = 0; j < width * 3; j++)
+                row[j] = (unsigned char)input[j % 3];
+        }
+        asn.processFrame(frame, mask);
+        if (k == MERGE_TEST_FRAMES - 1)
+            asn.getNeuronStats(stats);
+    }
+    const long pixelNum = (long)width * height;
+    const double neuronsPerPixel = (double)(stats.bgNeurons + stats.movingNeurons) / pixelNum;
+    printf("ArtSegment %dx%d merge %-3s: %ld merges, %.3f neurons/pixel; then %ld "
+           "evictions.\n", width, height, bMerge ? "on" : "off", stats.merges,
+           neuronsPerPixel, asn.getEvictions());
+    if (bMerge)
+        return (stats.merges != pixelNum) + (asn.getEvictions() != 0);
+    return (stats.merges != 0) + (asn.getEvictions() != pixelNum);
+}
+
+} // namespace
+
+///////////////////// Test ///////////////////////////////////////////////////////////////
+// usage: artmerge.out; fails if two neurons drifted together don't merge, or the merged
+// one's slot doesn't go back to the neuron budget.
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+    for (int merge = 1; merge >= 0; merge--)
+        failed += checkNetMerge(merge == 1) + checkSegmentMerge(40, 24, merge == 1);
+    return failed > 0 ? 1 : 0;
+}
@@ -4,6 +4,7 @@
 #include <sstream>
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
 #include <string>
 // tools
 #include <opencv2/core/core.hpp>
@@ -25,6 +26,10 @@ namespace
 
 #define SEQ_FILE_DIR ("./data")
 #define SEQ_FILE_MAX_NUM (500)
+#define ART_ROUND_TRIP_FILE ("./artSegment.roundTrip.snap")
+#define ART_ROUND_TRIP_FRAMES (10)
+#define ART_GATE_TILE_SIZE (16)
+#define ART_GATE_TOLERANCE (4)
     
 string intToString(const int n)
 {
@@ -53,10 +58,67 @@ void collectImageSequenceFiles(string & imgFileFolder, vector <string> & imgName
     return;
 }
 
+// the masks of both models on the last frames again; returns the differing frames.
+int compareLastFrames(ArtSegment & asn, ArtSegment & loaded,
+                      const vector<string> & imgFilePathes, const char * check)
+{
+    int diffFrames = 0;
+    const int first = std::max((int)imgFilePathes.size() - ART_ROUND_TRIP_FRAMES, 0);
+    for (int i = first; i < (int)imgFilePathes.size(); i++)
+    {
+        Mat inFrame = imread(imgFilePathes[i]);
+        Mat binaryFrame(480, 640, CV_8UC1), loadedFrame(480, 640, CV_8UC1);
+        asn.processFrame(inFrame, binaryFrame);
+        loaded.processFrame(inFrame, loadedFrame);
+        diffFrames += memcmp(binaryFrame.data, loadedFrame.data, 480 * 640) != 0;
+    }
+    printf("%s: %d of %d frames differ.\n", check, diffFrames,
+           (int)imgFilePathes.size() - first);
+    return diffFrames;
+}
+
+// the model saved & loaded into a fresh ArtSegment must give the same masks as the
+// original on the last frames again; the snapshot file is removed after. Returns the
+// differing frames.
+int checkSnapshotRoundTrip(ArtSegment & asn, const vector<string> & imgFilePathes)
+{
+    ArtSegment loaded(640, 480);
+    if (asn.saveSnapshot(ART_ROUND_TRIP_FILE) != 0 ||
+        loaded.loadSnapshot(ART_ROUND_TRIP_FILE) != 0)
+    {
+        printf("snapshot round trip: save or load of %s failed.\n", ART_ROUND_TRIP_FILE);
+        remove(ART_ROUND_TRIP_FILE);
+        return 1;
+    }
+    remove(ART_ROUND_TRIP_FILE);
+    return compareLastFrames(asn, loaded, imgFilePathes, "snapshot round trip");
+}
+
+// a gated model that loads its own snapshot back must go on like a fresh gated one that
+// loads it: the frames its tiles were skipped for before are forgotten, not replayed.
+int checkGatedSnapshotReload(ArtSegment & gated, const vector<string> & imgFilePathes)
+{
+    ArtSegment loaded(640, 480);
+    loaded.setChangeGating(ART_GATE_TILE_SIZE, ART_GATE_TOLERANCE);
+    if (gated.saveSnapshot(ART_ROUND_TRIP_FILE) != 0 ||
+        gated.loadSnapshot(ART_ROUND_TRIP_FILE) != 0 ||
+        loaded.loadSnapshot(ART_ROUND_TRIP_FILE) != 0)
+    {
+        printf("gated snapshot reload: save or load of %s failed.\n", ART_ROUND_TRIP_FILE);
+        remove(ART_ROUND_TRIP_FILE);
+        return 1;
+    }
+    remove(ART_ROUND_TRIP_FILE);
+    return compareLastFrames(gated, loaded, imgFilePathes, "gated snapshot reload");
+}
+
 } // namespace
 
 ///////////////////// Test ///////////////////////////////////////////////////////////////
 
+// usage: art.out [snapshot]; with a snapshot file, resume from it (if it is there) and save
+// to it at the end. Fails if the model doesn't round trip through a snapshot, or a gated one
+// doesn't reload its own like a fresh one.
 int main(int argc, char * argv[])
 {
     string imgFileFolder("./data");
@@ -64,11 +126,22 @@ int main(int argc, char * argv[])
     collectImageSequenceFiles(imgFileFolder, imgFilePathes);
 
     ArtSegment asn(640, 480);
+    asn.setThreadNum(boost::thread::hardware_concurrency() > 0 ?
+                     boost::thread::hardware_concurrency() : 1);
+    // for the snapshot reload check only
+    ArtSegment gated(640, 480);
+    gated.setChangeGating(ART_GATE_TILE_SIZE, ART_GATE_TOLERANCE);
+    // resume with the background learned by the run that saved the snapshot
+    const string snapshotFile(argc > 1 ? argv[1] : "");
+    if (snapshotFile.empty() == false && asn.loadSnapshot(snapshotFile) == 0)
+        printf("resume from snapshot %s.\n", snapshotFile.c_str());
     for(int i = 0; i < (int)imgFilePathes.size(); i ++)
     {
         //Mat readFrame = imread(imgFilePathes[i]);
         //Mat inFrame;         cvtColor(readFrame, inFrame, CV_BGR2Lab);
         Mat inFrame = imread(imgFilePathes[i]);
+        Mat gatedFrame(480, 640, CV_8UC1);
+        gated.processFrame(inFrame, gatedFrame);
         printf ("read in frame: %d, path %s, frameColorSpaceType %d.\n", 
                 i, imgFilePathes[i].c_str(), inFrame.type());
         Mat binaryFrame(480, 640, CV_8UC1);
@@ -91,5 +164,18 @@ int main(int argc, char * argv[])
         //getchar();
     } 
 
-    return 0;
+    ArtNeuronStats stats;
+    asn.getNeuronStats(stats);
+    printf("neurons: %ld bg, %ld moving, at most %d of %d a pixel, %ld evicted, %ld merged; "
+           "%.1f MB of %.1f MB model; full scans %.1f%% of the inputs.\n",
+           stats.bgNeurons, stats.movingNeurons, stats.maxPixelNeurons,
+           stats.pixelNeuronCap, stats.evictions, stats.merges,
+           stats.neuronBytes / (1024.0 * 1024.0),
+           stats.modelBytes / (1024.0 * 1024.0),
+           stats.pixelInputs > 0 ? stats.fullScans * 100.0 / stats.pixelInputs : 0.0);
+    if (snapshotFile.empty() == false)
+        asn.saveSnapshot(snapshotFile);
+    const int diffFrames = checkSnapshotRoundTrip(asn, imgFilePathes) +
+                           checkGatedSnapshotReload(gated, imgFilePathes);
+    return diffFrames == 0 ? 0 : 1;
 }
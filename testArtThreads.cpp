@@ -0,0 +1,118 @@
+// sys
+#include <stdio.h>
+#include <stdlib.h>
+// tools
+#include <opencv2/core/core.hpp>
+// project
+#include "artsegment.h"
+
+// namespaces
+using namespace cv;
+using namespace Art_Segment;
+
+///////////////////// Code ///////////////////////////////////////////////////////////////
+namespace
+{
+
+#define THREADS_TEST_FRAMES (300)
+
+// textured static background with sensor noise and a moving box; the lower quarter blinks
+// through the rgb cube's corners, so the pixels there want more neurons than a tight
+// budget has.
+void makeFrame(Mat & frame, const int width, const int height, const int frameNo)
+{
+    frame.create(height, width, CV_8UC3);
+    const int boxX = (frameNo * 4) % width;
+    const int boxY = height / 3;
+    for (int k = 0; k < height; k++)
+    {
+        unsigned char * row = frame.ptr<unsigned char>(k);
+        for (int j = 0; j < width; j++)
+        {
+            const bool bBox = j >= boxX && j < boxX + width / 8 &&
+                              k >= boxY && k < boxY + height / 6;
+            const int corner = (frameNo + (k * width + j) % 13) / 10 % 8;
+            const bool bLight = k >= height * 3 / 4 && corner > 0;
+            for (int c = 0; c < 3; c++)
+            {
+                const int bg = ((j * 3 + k * 5 + c * 40) & 0xFF) + rand() % 7 - 3;
+                const int v = bLight ? ((corner >> c) & 1) * 255 : (bBox ? 230 - c * 70 : bg);
+                row[j * 3 + c] = (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+            }
+        }
+    }
+    return;
+}
+
+// the masks of one thread with the winner fast path & of threadNum threads with or without
+// it on the same frames; returns the pixels where they differ, over all frames.
+long compareThreads(const vector<Mat> & frames, const int threadNum, const bool bFastPath,
+                    const long neuronBudget, const bool bGating, ArtNeuronStats & stats)
+{
+    const int width = frames[0].cols, height = frames[0].rows;
+    ArtSegment one(width, height), many(width, height);
+    many.setThreadNum(threadNum);
+    many.setWinnerFastPath(bFastPath);
+    if (neuronBudget > 0)
+    {
+        one.setNeuronBudget(ART_NEURON_SLOTS, neuronBudget);
+        many.setNeuronBudget(ART_NEURON_SLOTS, neuronBudget);
+    }
+    if (bGating)
+    {
+        one.setChangeGating(16, 4);
+        many.setChangeGating(16, 4);
+    }
+    Mat oneMask(height, width, CV_8UC1), manyMask(height, width, CV_8UC1);
+    long diffs = 0;
+    for (int k = 0; k < (int)frames.size(); k++)
+    {
+        one.processFrame(frames[k], oneMask);
+        many.processFrame(frames[k], manyMask);
+        for (int i = 0; i < height; i++)
+            for (int j = 0; j < width; j++)
+                diffs += oneMask.ptr<uchar>(i)[j] != manyMask.ptr<uchar>(i)[j];
+    }
+    many.getNeuronStats(stats);
+    return diffs;
+}
+
+} // namespace
+
+///////////////////// Test ///////////////////////////////////////////////////////////////
+// usage: artthreads.out [width height]; fails if a mask of several threads, or without the
+// winner fast path, differs from one thread's with it, with & without a tight neuron budget.
+int main(int argc, char * argv[])
+{
+    const int width = argc > 2 ? atoi(argv[1]) : 160;
+    const int height = argc > 2 ? atoi(argv[2]) : 120;
+    vector<Mat> frames(THREADS_TEST_FRAMES);
+    for (int k = 0; k < THREADS_TEST_FRAMES; k++)
+        makeFrame(frames[k], width, height, k);
+    const long pixelNum = (long)width * height;
+    const long budgets[] = {0, pixelNum * 5 / 4, pixelNum * 2};
+    // threads, & the fast path: a budget's tiles share it, so a neuron's death must free
+    // its place on the same frame with & without the fast path
+    const int threadNums[] = {2, 4, 8, 1, 4};
+    const bool bFastPaths[] = {true, true, true, false, false};
+    long failed = 0;
+    for (int b = 0; b < 3; b++)
+    {
+        for (int gating = 0; gating < 2; gating++)
+        {
+            for (int t = 0; t < 5; t++)
+            {
+                ArtNeuronStats stats;
+                const long diffs = compareThreads(frames, threadNums[t], bFastPaths[t],
+                                                  budgets[b], gating == 1, stats);
+                printf("ArtSegment %dx%d, budget %-7ld%s, 1 vs %d threads%s: %ld pixels "
+                       "differ (%ld neurons, %ld evictions).\n", width, height, budgets[b],
+                       gating == 1 ? " gated" : "      ", threadNums[t],
+                       bFastPaths[t] ? "        " : " no fast", diffs,
+                       stats.bgNeurons + stats.movingNeurons, stats.evictions);
+                failed += diffs;
+            }
+        }
+    }
+    return failed > 0 ? 1 : 0;
+}
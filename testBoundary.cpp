@@ -0,0 +1,132 @@
+// sys
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+// tools
+#include <opencv2/core/core.hpp>
+// project
+#include "boundaryScan.h"
+
+// namespaces
+using namespace cv;
+using namespace Seg_Three;
+
+///////////////////// Code ///////////////////////////////////////////////////////////////
+namespace
+{
+
+#define BOUNDARY_TEST_FRAMES (12)
+
+// strip pixel j's pattern in frame 'frameNo', strip row k: none, all, a run to the strip's
+// end, runs to the 64 bit words' ends, 1 - 3 pixel runs & gaps the morphology reshapes,
+// and random ones.
+bool isPatternForeground(const int j, const int k, const int width, const int frameNo)
+{
+    switch (frameNo)
+    {
+    case 0:
+        return false;
+    case 1:
+        return true;
+    case 2:
+        return j >= width / 2;
+    case 3:
+        return (j & 63) >= 40 || j == width - 1;
+    case 4:
+        return (j + k) % 3 != 0;
+    case 5:
+        return (j / (1 + k % 3)) % 2 == 0;
+    default:
+        return rand() % 100 < (frameNo - 5) * 14;
+    }
+}
+
+// top & bottom rows by the x along them, left & right columns by the y; where they cross,
+// either sets the pixel.
+void makeFrame(Mat & binary, const int width, const int height, const int skipTB,
+               const int skipLR, const int frameNo)
+{
+    binary.create(height, width, CV_8UC1);
+    memset(binary.data, 0, width * height);
+    const int stripTB = width - 2 * skipLR, stripLR = height - 2 * skipTB;
+    for (int y = skipTB; y < height - skipTB; y++)
+    {
+        for (int x = skipLR; x < width - skipLR; x++)
+        {
+            const int rowTB = std::min(y - skipTB, height - skipTB - 1 - y);
+            const int columnLR = std::min(x - skipLR, width - skipLR - 1 - x);
+            if (isPatternForeground(x - skipLR, rowTB, stripTB, frameNo) ||
+                isPatternForeground(y - skipTB, columnLR, stripLR, frameNo))
+                binary.at<uchar>(y, x) = 0xFF;
+        }
+    }
+    return;
+}
+
+// the bit path's scanned runs against the byte-wise check, on every pattern; returns the
+// mismatches, and the checked runs in 'runs'.
+long checkStrips(const int stripTB, const int stripLR, const int skipTB, const int skipLR,
+                 const int scanSizeTB, const int scanSizeLR, const VECTOR_KERNEL_LEVEL level,
+                 long & runs)
+{
+    const int width = stripTB + 2 * skipLR, height = stripLR + 2 * skipTB;
+    BoundaryScan scan;
+    scan.init(width, height, skipTB, skipLR, scanSizeTB, scanSizeLR, 1);
+    scan.setKernelLevel(level);
+    scan.setScanCheck(true);
+    srand(stripTB * 131 + stripLR);
+    BgResult bgResult;
+    for (int n = 0; n < BORDER_NUM; n++)
+    {
+        const int borderWidth = n < 2 ? stripTB : stripLR;
+        const int scanSize = n < 2 ? scanSizeTB : scanSizeLR;
+        bgResult.xMvs[n].assign(borderWidth * scanSize, 1.0);
+        bgResult.yMvs[n].assign(borderWidth * scanSize, -1.0);
+    }
+    for (int k = 0; k < BOUNDARY_TEST_FRAMES; k++)
+    {
+        makeFrame(bgResult.binaryData, width, height, skipTB, skipLR, k);
+        scan.processFrame(bgResult);
+    }
+    runs += scan.getCheckedRuns();
+    return scan.getRunMismatches();
+}
+
+} // namespace
+
+///////////////////// Test ///////////////////////////////////////////////////////////////
+// usage: boundary.out; fails if BoundaryScan's bit strips scan other runs than the bytes.
+int main(int argc, char * argv[])
+{
+    // strip widths about the 64 bit words' ends, & the 256 bit blocks' (past 256, the
+    // last pixel is in the word the block's morphology reads ahead)
+    const int widths[] = {63, 64, 65, 127, 128, 129, 255, 256, 257, 260};
+    // skipTB, skipLR, scanSizeTB, scanSizeLR: odd scan sizes leave a row out of the pairs,
+    // & more than 16 columns take the left / right strips' per pixel gather
+    const int strips[][4] = {{1, 1, 2, 2}, {3, 5, 1, 3}, {6, 2, 3, 1}, {2, 4, 4, 17}};
+    const char * levelStr[] = {"scalar", "SSE4", "AVX2"};
+    long failed = 0;
+    for (int level = VECTOR_KERNEL_SCALAR; level <= VECTOR_KERNEL_AVX2; level += 2)
+    {
+        for (int w = 0; w < (int)(sizeof(widths) / sizeof(widths[0])); w++)
+        {
+            long runs = 0, mismatches = 0;
+            for (int s = 0; s < (int)(sizeof(strips) / sizeof(strips[0])); s++)
+            {
+                const int * strip = strips[s];
+                // the same widths on all borders, & the top / bottom one off by a word
+                mismatches += checkStrips(widths[w], widths[w], strip[0], strip[1], strip[2],
+                                          strip[3], (VECTOR_KERNEL_LEVEL)level, runs);
+                mismatches += checkStrips(widths[w] + 64, widths[w], strip[0], strip[1],
+                                          strip[2], strip[3], (VECTOR_KERNEL_LEVEL)level,
+                                          runs);
+            }
+            printf("BoundaryScan %s, strips %3d pixels: %5ld runs, %ld mismatches%s.\n",
+                   levelStr[level], widths[w], runs, mismatches,
+                   getVectorKernelLevel((VECTOR_KERNEL_LEVEL)level) == level ? "" : " (n/a)");
+            failed += mismatches + (runs == 0);
+        }
+    }
+    return failed > 0 ? 1 : 0;
+}
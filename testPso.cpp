@@ -4,6 +4,7 @@
 #include <sstream>
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
 #include <string>
 // tools
 #include <opencv2/core/core.hpp>
@@ -25,6 +26,10 @@ namespace
 
 #define SEQ_FILE_DIR ("./data")
 #define SEQ_FILE_MAX_NUM (500)
+#define PSO_ROUND_TRIP_FILE ("./psoBook.roundTrip.snap")
+#define PSO_ROUND_TRIP_FRAMES (10)
+#define PSO_GATE_TILE_SIZE (16)
+#define PSO_GATE_TOLERANCE (4)
     
 string intToString(const int n)
 {
@@ -53,10 +58,68 @@ void collectImageSequenceFiles(string & imgFileFolder, vector <string> & imgName
     return;
 }
 
+// the masks of both models on the last frames again; returns the differing frames.
+int compareLastFrames(PsoBook & psoBook, PsoBook & loaded,
+                      const vector<string> & imgFilePathes, const char * check)
+{
+    int diffFrames = 0;
+    const int first = std::max((int)imgFilePathes.size() - PSO_ROUND_TRIP_FRAMES, 0);
+    for (int i = first; i < (int)imgFilePathes.size(); i++)
+    {
+        Mat inFrame = imread(imgFilePathes[i]);
+        Mat binaryFrame(480, 640, CV_8UC1), loadedFrame(480, 640, CV_8UC1);
+        psoBook.processFrameRgb(inFrame, binaryFrame);
+        loaded.processFrameRgb(inFrame, loadedFrame);
+        diffFrames += memcmp(binaryFrame.data, loadedFrame.data, 480 * 640) != 0;
+    }
+    printf("%s: %d of %d frames differ.\n", check, diffFrames,
+           (int)imgFilePathes.size() - first);
+    return diffFrames;
+}
+
+// the model saved & loaded into a fresh PsoBook must give the same masks as the original on
+// the last frames again; the snapshot file is removed after. Returns the differing frames.
+int checkSnapshotRoundTrip(PsoBook & psoBook, const vector<string> & imgFilePathes)
+{
+    PsoBook loaded;
+    loaded.init(640, 480);
+    if (psoBook.saveSnapshot(PSO_ROUND_TRIP_FILE) != 0 ||
+        loaded.loadSnapshot(PSO_ROUND_TRIP_FILE) != 0)
+    {
+        printf("snapshot round trip: save or load of %s failed.\n", PSO_ROUND_TRIP_FILE);
+        remove(PSO_ROUND_TRIP_FILE);
+        return 1;
+    }
+    remove(PSO_ROUND_TRIP_FILE);
+    return compareLastFrames(psoBook, loaded, imgFilePathes, "snapshot round trip");
+}
+
+// a gated model that loads its own snapshot back must go on like a fresh gated one that
+// loads it: the frames its tiles were skipped for before are forgotten, not replayed.
+int checkGatedSnapshotReload(PsoBook & gated, const vector<string> & imgFilePathes)
+{
+    PsoBook loaded;
+    loaded.setChangeGating(PSO_GATE_TILE_SIZE, PSO_GATE_TOLERANCE);
+    loaded.init(640, 480);
+    if (gated.saveSnapshot(PSO_ROUND_TRIP_FILE) != 0 ||
+        gated.loadSnapshot(PSO_ROUND_TRIP_FILE) != 0 ||
+        loaded.loadSnapshot(PSO_ROUND_TRIP_FILE) != 0)
+    {
+        printf("gated snapshot reload: save or load of %s failed.\n", PSO_ROUND_TRIP_FILE);
+        remove(PSO_ROUND_TRIP_FILE);
+        return 1;
+    }
+    remove(PSO_ROUND_TRIP_FILE);
+    return compareLastFrames(gated, loaded, imgFilePathes, "gated snapshot reload");
+}
+
 } // namespace
 
 ///////////////////// Test ///////////////////////////////////////////////////////////////
 
+// usage: pso.out [snapshot]; with a snapshot file, resume from it (if it is there) and save
+// to it at the end. Fails if the model doesn't round trip through a snapshot, or a gated one
+// doesn't reload its own like a fresh one.
 int main(int argc, char * argv[])
 {
     string imgFileFolder("./data");
@@ -65,11 +128,21 @@ int main(int argc, char * argv[])
 
     PsoBook psoBook;
     psoBook.init(640, 480);
+    // for the snapshot reload check only
+    PsoBook gated;
+    gated.setChangeGating(PSO_GATE_TILE_SIZE, PSO_GATE_TOLERANCE);
+    gated.init(640, 480);
+    // resume with the background learned by the run that saved the snapshot
+    const string snapshotFile(argc > 1 ? argv[1] : "");
+    if (snapshotFile.empty() == false && psoBook.loadSnapshot(snapshotFile) == 0)
+        printf("resume from snapshot %s.\n", snapshotFile.c_str());
     for(int i = 0; i < (int)imgFilePathes.size(); i++)
     {
         //Mat readFrame = imread(imgFilePathes[i]);
         //Mat inFrame;         cvtColor(readFrame, inFrame, CV_BGR2Lab);
         Mat inFrame = imread(imgFilePathes[i]);
+        Mat gatedFrame(480, 640, CV_8UC1);
+        gated.processFrameRgb(inFrame, gatedFrame);
         printf ("read in frame: %d, path %s, frameColorSpaceType %d.\n", 
                 i, imgFilePathes[i].c_str(), inFrame.type());
         Mat binaryFrame(480, 640, CV_8UC1);
@@ -94,5 +167,9 @@ int main(int argc, char * argv[])
         //getchar();
     } 
 
-    return 0;
+    if (snapshotFile.empty() == false)
+        psoBook.saveSnapshot(snapshotFile);
+    const int diffFrames = checkSnapshotRoundTrip(psoBook, imgFilePathes) +
+                           checkGatedSnapshotReload(gated, imgFilePathes);
+    return diffFrames == 0 ? 0 : 1;
 }
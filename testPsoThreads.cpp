@@ -0,0 +1,133 @@
+// sys
+#include <stdio.h>
+#include <stdlib.h>
+// tools
+#include <opencv2/core/core.hpp>
+// project
+#include "psoBook.h"
+
+// namespaces
+using namespace cv;
+using namespace Seg_Three;
+
+///////////////////// Code ///////////////////////////////////////////////////////////////
+namespace
+{
+
+#define THREADS_TEST_FRAMES (60)
+
+// textured static background with sensor noise and a moving box
+void makeFrame(Mat & frame, const int width, const int height, const int channels,
+               const int frameNo)
+{
+    frame.create(height, width, channels == 3 ? CV_8UC3 : CV_8UC1);
+    const int boxX = (frameNo * 4) % width;
+    const int boxY = height / 3;
+    for (int k = 0; k < height; k++)
+    {
+        unsigned char * row = frame.ptr<unsigned char>(k);
+        for (int j = 0; j < width; j++)
+        {
+            const bool bBox = j >= boxX && j < boxX + width / 8 &&
+                              k >= boxY && k < boxY + height / 6;
+            for (int c = 0; c < channels; c++)
+            {
+                const int bg = ((j * 3 + k * 5 + c * 40) & 0xFF) + rand() % 21 - 10;
+                const int v = bBox ? 230 - c * 70 : bg;
+                row[j * channels + c] = (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+            }
+        }
+    }
+    return;
+}
+
+// the masks of a book on all frames; returns its kernel mismatches.
+long runPsoBook(PsoBook & psoBook, const vector<Mat> & frames, vector<Mat> & masks)
+{
+    masks.resize(frames.size());
+    for (int k = 0; k < (int)frames.size(); k++)
+    {
+        masks[k].create(frames[k].rows, frames[k].cols, CV_8UC1);
+        if (frames[k].channels() == 3)
+            psoBook.processFrameRgb(frames[k], masks[k]);
+        else
+            psoBook.processFrameGray(frames[k], masks[k]);
+    }
+    return psoBook.getKernelMismatches();
+}
+
+void setupPsoBook(PsoBook & psoBook, const PSO_MODEL_TYPE type, const int width,
+                  const int height, const int channels, const bool bGating)
+{
+    psoBook.setModelType(type);
+    psoBook.init(width, height, channels);
+    if (bGating)
+        psoBook.setChangeGating(16, 4);
+    return;
+}
+
+long countDiffs(const vector<Mat> & masks, const vector<Mat> & others)
+{
+    long diffs = 0;
+    for (int k = 0; k < (int)masks.size(); k++)
+        for (int i = 0; i < masks[k].rows; i++)
+            for (int j = 0; j < masks[k].cols; j++)
+                diffs += masks[k].ptr<uchar>(i)[j] != others[k].ptr<uchar>(i)[j];
+    return diffs;
+}
+
+} // namespace
+
+///////////////////// Test ///////////////////////////////////////////////////////////////
+// usage: psothreads.out [width height]; fails if a mask of several bands, of the streaming
+// window or of the SIMD kernels differs from one band's with whole frame passes & the
+// scalar path, or the kernels differ from it on a pixel (PSO_KERNEL_CHECK).
+int main(int argc, char * argv[])
+{
+    const int width = argc > 2 ? atoi(argv[1]) : 161;
+    const int height = argc > 2 ? atoi(argv[2]) : 123;
+    const char * typeStr[] = {"double ", "compact"};
+    const int threadNums[] = {1, 4, 7};
+    long failed = 0;
+    for (int channels = 3; channels >= 1; channels -= 2)
+    {
+        vector<Mat> frames(THREADS_TEST_FRAMES);
+        for (int k = 0; k < THREADS_TEST_FRAMES; k++)
+            makeFrame(frames[k], width, height, channels, k);
+        for (int type = PSO_MODEL_DOUBLE; type <= PSO_MODEL_COMPACT; type++)
+        {
+            for (int gating = 0; gating < 2; gating++)
+            {
+                PsoBook serial;
+                serial.setKernelMode(PSO_KERNEL_SCALAR);
+                serial.setStreamingMode(false);
+                setupPsoBook(serial, (PSO_MODEL_TYPE)type, width, height, channels,
+                             gating == 1);
+                vector<Mat> serialMasks;
+                runPsoBook(serial, frames, serialMasks);
+                for (int t = 0; t < 3; t++)
+                {
+                    for (int streaming = 0; streaming < 2; streaming++)
+                    {
+                        PsoBook banded;
+                        banded.setKernelMode(PSO_KERNEL_CHECK);
+                        banded.setThreadNum(threadNums[t]);
+                        banded.setStreamingMode(streaming == 1);
+                        setupPsoBook(banded, (PSO_MODEL_TYPE)type, width, height, channels,
+                                     gating == 1);
+                        vector<Mat> bandedMasks;
+                        const long mismatches = runPsoBook(banded, frames, bandedMasks);
+                        const long diffs = countDiffs(serialMasks, bandedMasks);
+                        printf("PsoBook %dx%dx%d %s%s, %d threads, %s: %ld pixels differ, "
+                               "%s kernel %ld mismatches.\n", width, height, channels,
+                               typeStr[type], gating == 1 ? " gated" : "      ",
+                               threadNums[t], streaming == 1 ? "streaming" : "frame    ",
+                               diffs, banded.getKernelStr(), mismatches);
+                        failed += diffs + mismatches;
+                    }
+                }
+            }
+        }
+    }
+    return failed > 0 ? 1 : 0;
+}
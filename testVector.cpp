@@ -1,10 +1,104 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <vector>
+#include <opencv2/core/core.hpp>
 #include "vectorSpace.h"
 
 using std :: vector;
 using namespace Vector_Space;
 
+namespace
+{
+
+#define VECTOR_BENCH_UPDATES (1000000)
+
+// ns a winner update of the neurons, 'w = w + ((x - w) * rate)'
+template <typename V>
+double benchWinnerUpdate(V & w, const V & x, const double rate)
+{
+    const int64 start = cv::getTickCount();
+    for (int k = 0; k < VECTOR_BENCH_UPDATES; k++)
+        w = w + ((x - w) * rate);
+    return (cv::getTickCount() - start) * 1e9 / cv::getTickFrequency() / VECTOR_BENCH_UPDATES;
+}
+
+// the same update by hand, as one loop
+double benchWinnerUpdateLoop(vector<double> & w, const vector<double> & x, const double rate)
+{
+    const int64 start = cv::getTickCount();
+    for (int k = 0; k < VECTOR_BENCH_UPDATES; k++)
+        for (int c = 0; c < (int)w.size(); c++)
+            w[c] = w[c] + ((x[c] - w[c]) * rate);
+    return (cv::getTickCount() - start) * 1e9 / cv::getTickFrequency() / VECTOR_BENCH_UPDATES;
+}
+
+void benchWinnerUpdates(const int dim)
+{
+    vector<double> x(dim, 0.0);
+    for (int c = 0; c < dim; c++)
+        x[c] = c * 7 % 255;
+    VectorSpace<double> dynamicW(vector<double>(dim, 0.0));
+    const double dynamicNs = benchWinnerUpdate(dynamicW, VectorSpace<double>(x), 0.1);
+    vector<double> loopW(dim, 0.0);
+    const double loopNs = benchWinnerUpdateLoop(loopW, x, 0.1);
+    printf("winner update, %2d components: VectorSpace<double> %6.1f ns, loop %6.1f ns",
+           dim, dynamicNs, loopNs);
+    if (dim == 3)
+    {
+        VectorSpace<double, 3> fixedW(0.0, 0.0, 0.0);
+        const double fixedNs = benchWinnerUpdate(fixedW, VectorSpace<double, 3>(x[0], x[1], x[2]),
+                                                 0.1);
+        printf(", VectorSpace<double, 3> %6.1f ns (w %.1f %.1f)", fixedNs, fixedW[2],
+               dynamicW.components()[2]);
+    }
+    printf(".\n");
+    return;
+}
+
+// the batched rgb distances of every kernel against one rgbEulerDistance a pair, and
+// their ns a distance; returns the mismatches
+int checkRgbDistances(const int K)
+{
+    typedef VectorSpace<double, 3> Rgb;
+    vector<Rgb> inputs(K), weights(K);
+    for (int k = 0; k < K; k++)
+    {
+        inputs[k] = Rgb(rand() % 256, rand() % 256, rand() % 256);
+        weights[k] = Rgb(rand() % 25600 / 100.0, rand() % 25600 / 100.0, rand() % 25600 / 100.0);
+    }
+    vector<int> squared(K);
+    int mismatches = 0;
+    const char * levelStr[] = {"scalar", "SSE4", "AVX2"};
+    printf("rgb distances, %d weights:", K);
+    for (int level = VECTOR_KERNEL_SCALAR; level <= VECTOR_KERNEL_AVX2; level++)
+    {
+        const int64 start = cv::getTickCount();
+        for (int n = 0; n < VECTOR_BENCH_UPDATES / K; n++)
+            rgbSquaredDistances(inputs[0].components().data(), 0,
+                                weights[0].components().data(), K, &squared[0],
+                                (VECTOR_KERNEL_LEVEL)level);
+        const double ns = (cv::getTickCount() - start) * 1e9 / cv::getTickFrequency() /
+                          (VECTOR_BENCH_UPDATES / K * K);
+        for (int k = 0; k < K; k++)
+            mismatches += squared[k] != Rgb::rgbSquaredDistance(weights[k], inputs[0]);
+        // k-th input against the k-th weights
+        rgbSquaredDistances(inputs[0].components().data(), 3, weights[0].components().data(),
+                            K, &squared[0], (VECTOR_KERNEL_LEVEL)level);
+        for (int k = 0; k < K; k++)
+            mismatches += squared[k] != Rgb::rgbSquaredDistance(weights[k], inputs[k]);
+        printf(" %s %.2f ns%s", levelStr[level], ns,
+               getVectorKernelLevel((VECTOR_KERNEL_LEVEL)level) == level ? "" : " (n/a)");
+    }
+    vector<double> distances(K);
+    Rgb::rgbEulerDistances(inputs[0], &weights[0], K, &distances[0]);
+    for (int k = 0; k < K; k++)
+        mismatches += distances[k] != Rgb::rgbEulerDistance(weights[k], inputs[0]);
+    printf(", %d mismatches.\n", mismatches);
+    return mismatches;
+}
+
+} // namespace
+
 int main (int argc, char ** argv)
 {    
     vector<double> v1(3, 0);
@@ -39,5 +133,27 @@ int main (int argc, char ** argv)
     (vs1 * 2).dumpComponents();
 
     printf("Euler: %.2f\n", VectorSpace<double>::generalEulerDistance(vs1, vs2));   
-    return 0;
+
+    // fixed size: no heap, evaluated at compile time when the operands are constant
+    constexpr VectorSpace<double, 3> fs1(1.0, 2.0, 3.0);
+    constexpr VectorSpace<double, 3> fs2(4.0, 5.0, 6.0);
+    static_assert((fs1 + fs2)[2] == 9.0 && (fs1 - fs2)[0] == -3.0 && (fs1 * 2.0)[1] == 4.0,
+                  "constexpr arithmetic");
+    static_assert(VectorSpace<double, 3>::squaredEulerDistance(fs1, fs2) == 27.0,
+                  "constexpr squared distance");
+    printf("fixed Addition: \n");
+    (fs1 + fs2).dumpComponents();
+    printf("fixed Minus: \n");
+    (fs1 - fs2).dumpComponents();
+    printf("fixed scale: \n");
+    (fs1 * 2.0).dumpComponents();
+    printf("fixed Euler: %.2f\n", VectorSpace<double, 3>::generalEulerDistance(fs1, fs2));
+    const double rgb = VectorSpace<double>::rgbEulerDistance(vs1, vs2);
+    const double fixedRgb = VectorSpace<double, 3>::rgbEulerDistance(fs1, fs2);
+    printf("rgb: %.2f, fixed rgb: %.2f\n", rgb, fixedRgb);
+
+    benchWinnerUpdates(3);
+    benchWinnerUpdates(64);
+    const int mismatches = checkRgbDistances(8) + checkRgbDistances(67);
+    return rgb == fixedRgb && mismatches == 0 ? 0 : 1;
 }
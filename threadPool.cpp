@@ -0,0 +1,191 @@
+#include "threadPool.h"
+
+namespace Seg_Three
+{
+namespace
+{
+inline unsigned long long packRange(const unsigned int begin, const unsigned int end)
+{
+    return ((unsigned long long)begin << 32) | end;
+}
+} // namespace
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+//// constructor / destructor / init
+ThreadPool :: ThreadPool()
+    : m_taskNum(0)
+    , m_generation(0)
+    , m_busyWorkers(0)
+    , m_bQuit(false)
+    , m_nextTask(0)
+    , m_bStealing(false)
+{
+    return;
+}
+
+ThreadPool :: ~ThreadPool()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        m_bQuit = true;
+    }
+    m_wakeCond.notify_all();
+    for (int k = 0; k < (int)m_workers.size(); k++)
+    {
+        m_workers[k]->join();
+        delete m_workers[k];
+    }
+    return;
+}
+
+int ThreadPool :: init(const int threadNum)
+{
+    if (m_workers.size() > 0 || threadNum < 1)
+        return -1;
+    m_taskRanges = vector<TaskRange>(threadNum);
+    for (int k = 0; k < threadNum - 1; k++)
+        m_workers.push_back(new boost::thread(&ThreadPool::workerLoop, this, k + 1));
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//// APIs
+void ThreadPool :: parallelFor(const int taskNum,
+                               const boost::function<void (const int)> & task)
+{
+    if (m_workers.size() == 0 || taskNum <= 1)
+    {
+        for (int k = 0; k < taskNum; k++)
+            task(k);
+        return;
+    }
+
+    startJob(taskNum, task, false);
+    return;
+}
+
+void ThreadPool :: parallelForStealing(const int taskNum,
+                                       const boost::function<void (const int)> & task)
+{
+    if (m_workers.size() == 0 || taskNum <= 1)
+    {
+        for (int k = 0; k < taskNum; k++)
+            task(k);
+        return;
+    }
+    startJob(taskNum, task, true);
+    return;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//// Internal Helpers
+void ThreadPool :: startJob(const int taskNum, const boost::function<void (const int)> & task,
+                            const bool bStealing)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        m_task = task;
+        m_taskNum = taskNum;
+        m_nextTask = 0;
+        m_bStealing = bStealing;
+        if (bStealing)
+        {
+            const int threadNum = (int)m_taskRanges.size();
+            for (int k = 0; k < threadNum; k++)
+                m_taskRanges[k].range = packRange((long)taskNum * k / threadNum,
+                                                  (long)taskNum * (k + 1) / threadNum);
+        }
+        m_busyWorkers = (int)m_workers.size();
+        m_generation++;
+    }
+    m_wakeCond.notify_all();
+    runTasks(0);
+
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    while (m_busyWorkers > 0)
+        m_doneCond.wait(lock);
+    return;
+}
+
+void ThreadPool :: workerLoop(const int threadIdx)
+{
+    unsigned int seenGeneration = 0;
+    while (true)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(m_mutex);
+            while (m_bQuit == false && m_generation == seenGeneration)
+                m_wakeCond.wait(lock);
+            if (m_bQuit == true)
+                return;
+            seenGeneration = m_generation;
+        }
+        runTasks(threadIdx);
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        if (--m_busyWorkers == 0)
+            m_doneCond.notify_one();
+    }
+}
+
+void ThreadPool :: runTasks(const int threadIdx)
+{
+    if (m_bStealing == false)
+    {
+        for (int k = m_nextTask++; k < m_taskNum; k = m_nextTask++)
+            m_task(k);
+        return;
+    }
+    do
+    {
+        for (int k = popTask(threadIdx); k >= 0; k = popTask(threadIdx))
+            m_task(k);
+    }
+    while (stealTasks(threadIdx));
+    return;
+}
+
+// the front task of the thread's own share, -1 if it is empty
+int ThreadPool :: popTask(const int threadIdx)
+{
+    boost::atomic<unsigned long long> & range = m_taskRanges[threadIdx].range;
+    unsigned long long r = range.load();
+    while (true)
+    {
+        const unsigned int begin = (unsigned int)(r >> 32);
+        const unsigned int end = (unsigned int)r;
+        if (begin >= end)
+            return -1;
+        if (range.compare_exchange_weak(r, packRange(begin + 1, end)))
+            return (int)begin;
+    }
+}
+
+// move the back half of the first non empty share (from the next thread on) into the
+// thread's own, which is empty; false if every share is.
+bool ThreadPool :: stealTasks(const int threadIdx)
+{
+    const int threadNum = (int)m_taskRanges.size();
+    for (int n = 1; n < threadNum; n++)
+    {
+        boost::atomic<unsigned long long> & range =
+            m_taskRanges[(threadIdx + n) % threadNum].range;
+        unsigned long long r = range.load();
+        while (true)
+        {
+            const unsigned int begin = (unsigned int)(r >> 32);
+            const unsigned int end = (unsigned int)r;
+            if (begin >= end)
+                break;
+            const unsigned int middle = begin + (end - begin) / 2;
+            if (range.compare_exchange_weak(r, packRange(begin, middle)))
+            {
+                m_taskRanges[threadIdx].range = packRange(middle, end);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+} // namespace Seg_Three
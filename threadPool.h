@@ -0,0 +1,67 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+// sys
+#include <vector>
+// tools
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include <boost/atomic.hpp>
+
+using :: std :: vector;
+
+namespace Seg_Three
+{
+//////////////////////////////////////////////////////////////////////////////////////////
+// Minimal fork-join pool for the per pixel models: 'parallelFor' hands task indices
+// [0, taskNum) to the workers and the calling thread, and returns when all are done, so
+// consecutive calls are separated by a barrier.
+// 'parallelForStealing' is for many small tasks of uneven cost: each thread starts on its
+// own contiguous share of the indices (neighbour tasks stay on one core), and a thread
+// that runs out steals the back half of another thread's remaining share.
+class ThreadPool
+{
+public:
+    ThreadPool();
+    ~ThreadPool();
+    // threadNum includes the calling thread, so threadNum - 1 workers are started.
+    int init(const int threadNum);
+    int getThreadNum() const {return (int)m_workers.size() + 1;}
+    void parallelFor(const int taskNum, const boost::function<void (const int)> & task);
+    void parallelForStealing(const int taskNum,
+                             const boost::function<void (const int)> & task);
+
+private:
+    // [begin, end) of one thread's task share in one word, so the owner's pop & a thief's
+    // split are single compare-and-swaps; padded to its own cache line.
+    struct TaskRange
+    {
+        boost::atomic<unsigned long long> range;
+        char pad[64 - sizeof(boost::atomic<unsigned long long>)];
+    };
+
+    vector<boost::thread *> m_workers;
+    boost::mutex m_mutex;
+    boost::condition_variable m_wakeCond;
+    boost::condition_variable m_doneCond;
+    // current job, guarded by m_mutex except the task counter
+    boost::function<void (const int)> m_task;
+    int m_taskNum;
+    unsigned int m_generation;
+    int m_busyWorkers;
+    bool m_bQuit;
+    boost::atomic<int> m_nextTask;
+    bool m_bStealing;
+    vector<TaskRange> m_taskRanges; // per thread, 0 is the calling thread
+
+    void startJob(const int taskNum, const boost::function<void (const int)> & task,
+                  const bool bStealing);
+    void workerLoop(const int threadIdx);
+    void runTasks(const int threadIdx);
+    int popTask(const int threadIdx);
+    bool stealTasks(const int threadIdx);
+};
+
+} // namespace Seg_Three
+
+#endif // _THREAD_POOL_H_
@@ -0,0 +1,154 @@
+// sys
+#include <algorithm>
+#include <assert.h>
+#include <stdlib.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+// project
+#include "tileGate.h"
+
+namespace Seg_Three
+{
+namespace
+{
+// sum of absolute differences of n bytes
+int rowSad(const unsigned char * x, const unsigned char * r, const int n)
+{
+    int sad = 0;
+    int j = 0;
+#if defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    for (/**/; j + 16 <= n; j += 16)
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(x + j)),
+                                              _mm_loadu_si128((const __m128i *)(r + j))));
+    sad = _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+    for (/**/; j < n; j++)
+        sad += abs(x[j] - r[j]);
+    return sad;
+}
+} // namespace
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//// TileGate class method
+int TileGate :: init(const int width, const int height, const int channels,
+                     const int tileSize, const int tolerance)
+{
+    if (tileSize < 0 || (tileSize > 0 && tileSize < 4) || tolerance < 0)
+        return -1;
+    m_width = width;
+    m_height = height;
+    m_channels = channels;
+    m_tileSize = tileSize;
+    m_tolerance = tolerance;
+    m_bReference = false;
+    m_skippedTiles = 0;
+    if (m_tileSize == 0)
+    {
+        m_tileRows = m_tileCols = 0;
+        m_active.clear();
+        m_quietFrames.clear();
+        m_skippedFrames.clear();
+        m_pendingFrames.clear();
+        m_reference.clear();
+        m_lastMask.clear();
+        return 0;
+    }
+    m_tileRows = (m_height + m_tileSize - 1) / m_tileSize;
+    m_tileCols = (m_width + m_tileSize - 1) / m_tileSize;
+    m_active.assign(m_tileRows * m_tileCols, 1);
+    m_quietFrames.assign(m_tileRows * m_tileCols, 0);
+    m_skippedFrames.assign(m_tileRows * m_tileCols, 0);
+    m_pendingFrames.assign(m_tileRows * m_tileCols, 0);
+    m_reference.assign(m_width * m_height * m_channels, 0);
+    m_lastMask.assign(m_width * m_height, 0);
+    return 0;
+}
+
+void TileGate :: reset()
+{
+    m_bReference = false;
+    m_skippedTiles = 0;
+    std::fill(m_quietFrames.begin(), m_quietFrames.end(), 0);
+    std::fill(m_skippedFrames.begin(), m_skippedFrames.end(), 0);
+    std::fill(m_pendingFrames.begin(), m_pendingFrames.end(), 0);
+    return;
+}
+
+int TileGate :: update(const cv::Mat & in)
+{
+    assert(in.cols == m_width && in.rows == m_height && in.channels() == m_channels);
+    m_skippedTiles = 0;
+    for (int tr = 0; tr < m_tileRows; tr++)
+    {
+        const int rowBegin = tr * m_tileSize;
+        const int rowEnd = std::min(rowBegin + m_tileSize, m_height);
+        for (int tc = 0; tc < m_tileCols; tc++)
+        {
+            const int t = tr * m_tileCols + tc;
+            if (m_bReference == false || isTileChanged(in, tr, tc))
+                m_quietFrames[t] = 0;
+            else
+                m_quietFrames[t]++;
+            const bool bActive = m_quietFrames[t] < TILE_GATE_HOLD_FRAMES;
+            m_active[t] = bActive ? 1 : 0;
+            if (bActive == false)
+            {
+                m_skippedFrames[t]++;
+                m_skippedTiles++;
+                continue;
+            }
+            m_pendingFrames[t] = m_skippedFrames[t];
+            m_skippedFrames[t] = 0;
+            // the reference follows the input the tile is processed with
+            const int colBegin = tc * m_tileSize * m_channels;
+            const int bytes = (std::min((tc + 1) * m_tileSize, m_width) - tc * m_tileSize) *
+                              m_channels;
+            for (int k = rowBegin; k < rowEnd; k++)
+                memcpy(&m_reference[k * m_width * m_channels + colBegin],
+                       in.ptr<unsigned char>(k) + colBegin, bytes);
+        }
+    }
+    m_bReference = true;
+    return (int)m_active.size() - m_skippedTiles;
+}
+
+bool TileGate :: isTileChanged(const cv::Mat & in, const int tileRow, const int tileCol)
+{
+    const int rowBegin = tileRow * m_tileSize;
+    const int rowEnd = std::min(rowBegin + m_tileSize, m_height);
+    const int colBegin = tileCol * m_tileSize * m_channels;
+    const int colEnd = std::min((tileCol + 1) * m_tileSize, m_width) * m_channels;
+    const long maxSad = (long)m_tolerance * (rowEnd - rowBegin) * (colEnd - colBegin);
+    long sad = 0;
+    for (int k = rowBegin; k < rowEnd; k++)
+    {
+        sad += rowSad(in.ptr<unsigned char>(k) + colBegin,
+                      &m_reference[k * m_width * m_channels + colBegin], colEnd - colBegin);
+        if (sad > maxSad)
+            return true;
+    }
+    return false;
+}
+
+void TileGate :: applyMask(cv::Mat & out)
+{
+    for (int k = 0; k < m_height; k++)
+    {
+        unsigned char * o = out.ptr<unsigned char>(k);
+        unsigned char * last = &m_lastMask[k * m_width];
+        for (int tc = 0; tc < m_tileCols; tc++)
+        {
+            const int colBegin = tc * m_tileSize;
+            const int bytes = std::min(colBegin + m_tileSize, m_width) - colBegin;
+            if (isRowActive(k, tc))
+                memcpy(last + colBegin, o + colBegin, bytes);
+            else
+                memcpy(o + colBegin, last + colBegin, bytes);
+        }
+    }
+    return;
+}
+
+} // namespace Seg_Three
@@ -0,0 +1,99 @@
+#ifndef _TILE_GATE_H_
+#define _TILE_GATE_H_
+
+// sys
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+// tools - just using Mat
+#include <opencv2/core/core.hpp>
+
+// namespace
+using :: std :: vector;
+
+namespace Seg_Three
+{
+//////////////////////////////////////////////////////////////////////////////////////////
+//// Change gating of the per pixel background models: the frame is cut into square tiles,
+//// and a tile is only processed when its mean absolute difference to the input it was
+//// last processed with is above the tolerance. Skipped tiles keep their last mask; their
+//// neurons are aged lazily, by the skipped frame count, when the tile is processed again.
+// The reference is only refreshed for processed tiles, so slow drift still wakes a tile.
+// A changed tile is held active for a while, so its mask settles before it is kept.
+enum {TILE_GATE_HOLD_FRAMES = 8};
+
+class TileGate
+{
+public:
+    TileGate()
+        : m_width(0), m_height(0), m_channels(0), m_tileSize(0), m_tolerance(0)
+        , m_tileRows(0), m_tileCols(0), m_bReference(false), m_skippedTiles(0)
+    {}
+    // tileSize 0: gating off, every tile is processed.
+    int init(const int width, const int height, const int channels,
+             const int tileSize, const int tolerance);
+    bool isEnabled() const {return m_tileSize > 0;}
+    // forget the reference & the skipped frames, the next frame processes every tile as
+    // the first one does.
+    void reset();
+    // per frame, before processing: mark the changed tiles; returns the active tile num.
+    int update(const cv::Mat & in);
+    // per frame, after processing: skipped tiles take their last mask back, the active
+    // tiles' mask is kept for the frames they will be skipped.
+    void applyMask(cv::Mat & out);
+
+    int getTileSize() const {return m_tileSize;}
+    int getTileCols() const {return m_tileCols;}
+    bool isActive(const int tileRow, const int tileCol) const
+    {
+        return m_active[tileRow * m_tileCols + tileCol] != 0;
+    }
+    // tile of pixel row k is processed (refined & updated) in this frame
+    bool isRowActive(const int k, const int tileCol) const
+    {
+        return isActive(k / m_tileSize, tileCol);
+    }
+    // row k must be classified under this tile: it, or a tile whose 3x3 refine reads row
+    // k (the tile above/below at tile edges), is active. Columns take 1 pixel of halo.
+    bool isRowClassified(const int k, const int tileCol) const
+    {
+        const int tileRow = k / m_tileSize;
+        return isActive(tileRow, tileCol) ||
+               (k % m_tileSize == 0 && tileRow > 0 && isActive(tileRow - 1, tileCol)) ||
+               (k % m_tileSize == m_tileSize - 1 && tileRow + 1 < m_tileRows &&
+                isActive(tileRow + 1, tileCol));
+    }
+    // frames the tile was skipped before this frame processes it again
+    unsigned int getPendingFrames(const int k, const int tileCol) const
+    {
+        return m_pendingFrames[(k / m_tileSize) * m_tileCols + tileCol];
+    }
+    // mask the tile had when it was last processed
+    const unsigned char * getLastMask(const int k) const {return &m_lastMask[k * m_width];}
+    double getSkippedFraction() const
+    {
+        return m_active.size() > 0 ? (double)m_skippedTiles / m_active.size() : 0.0;
+    }
+
+private:
+    int m_width;
+    int m_height;
+    int m_channels;
+    int m_tileSize;
+    int m_tolerance; // mean absolute difference per channel value
+    int m_tileRows;
+    int m_tileCols;
+    bool m_bReference;
+    int m_skippedTiles;
+    vector<unsigned char> m_active;
+    vector<unsigned int> m_quietFrames;   // unchanged frames in a row, per tile
+    vector<unsigned int> m_skippedFrames; // frames skipped in a row, per tile
+    vector<unsigned int> m_pendingFrames; // m_skippedFrames when the tile woke up
+    vector<unsigned char> m_reference; // input of the last processed frame, per tile
+    vector<unsigned char> m_lastMask;
+    bool isTileChanged(const cv::Mat & in, const int tileRow, const int tileCol);
+};
+
+} // namespace Seg_Three
+
+#endif // _TILE_GATE_H_
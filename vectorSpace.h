@@ -5,21 +5,330 @@
 #include <math.h>
 #include <iostream>
 #include <vector>
+#include <array>
+#include <limits>
+#if defined(__x86_64__) || defined(__i386__)
+#define VECTOR_SPACE_X86
+#include <immintrin.h>
+#endif
 
 using :: std :: vector;
 
 namespace Vector_Space
 {
 
+enum {VECTOR_DYNAMIC = 0}; // VectorSpace's dimension: the components' vector size
+
+// the rgb distance's square, on the truncated mean red & component differences
+constexpr int rgbSquaredDistance(const int meanRed, const int r, const int g, const int b)
+{
+    return (((512 + meanRed)*r*r)>>8) + 4*g*g + (((767-meanRed)*b*b)>>8);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//// batched rgb distances: the input against K contiguous rgb weight vectors, or K inputs
+//// against K weights (inputStep 0 or 3 doubles). The SSE4 / AVX2 kernels do the formular's
+//// integer part in int lanes, on the same truncated meanRed / r / g / b as the scalar one,
+//// so all give the very same distances.
+enum VECTOR_KERNEL_LEVEL {VECTOR_KERNEL_SCALAR = 0, VECTOR_KERNEL_SSE4, VECTOR_KERNEL_AVX2};
+
 template <typename T>
-class VectorSpace
+void rgbSquaredDistancesScalar(const T * input, const int inputStep, const T * weights,
+                               const int K, int * squared)
+{
+    for (int k = 0; k < K; k++, input += inputStep, weights += 3)
+        squared[k] = rgbSquaredDistance((int)((weights[0] + input[0]) / 2),
+                                        (int)(weights[0] - input[0]),
+                                        (int)(weights[1] - input[1]),
+                                        (int)(weights[2] - input[2]));
+}
+
+#ifdef VECTOR_SPACE_X86
+// the integer part of the formular, on 4 truncated lanes
+__attribute__((target("sse4.1")))
+inline __m128i rgbSquaredDistanceLanes(const __m128i meanRed,
+                                       const __m128i r, const __m128i g, const __m128i b)
+{
+    const __m128i rr = _mm_srai_epi32(_mm_mullo_epi32(
+        _mm_add_epi32(meanRed, _mm_set1_epi32(512)), _mm_mullo_epi32(r, r)), 8);
+    const __m128i gg = _mm_slli_epi32(_mm_mullo_epi32(g, g), 2);
+    const __m128i bb = _mm_srai_epi32(_mm_mullo_epi32(
+        _mm_sub_epi32(_mm_set1_epi32(767), meanRed), _mm_mullo_epi32(b, b)), 8);
+    return _mm_add_epi32(_mm_add_epi32(rr, gg), bb);
+}
+
+// 2 interleaved rgb vectors [a0 a1 a2 b0 b1 b2] into [a0 b0] [a1 b1] [a2 b2]
+__attribute__((target("sse4.1")))
+inline void loadRgb2(const double * v, __m128d * c)
+{
+    const __m128d m0 = _mm_loadu_pd(v);
+    const __m128d m1 = _mm_loadu_pd(v + 2);
+    const __m128d m2 = _mm_loadu_pd(v + 4);
+    c[0] = _mm_blend_pd(m0, m1, 2);
+    c[1] = _mm_shuffle_pd(m0, m2, 1);
+    c[2] = _mm_blend_pd(m1, m2, 2);
+}
+
+__attribute__((target("sse4.1")))
+inline void rgbSquaredDistancesSse4(const double * input, const int inputStep,
+                                    const double * weights, const int K, int * squared)
+{
+    __m128d x[3];
+    for (int c = 0; c < 3; c++)
+        x[c] = _mm_set1_pd(input[c]);
+    int k = 0;
+    for (/**/; k + 2 <= K; k += 2, input += 2 * inputStep, weights += 6)
+    {
+        if (inputStep != 0)
+            loadRgb2(input, x);
+        __m128d w[3];
+        loadRgb2(weights, w);
+        const __m128i meanRed = _mm_cvttpd_epi32(_mm_mul_pd(_mm_add_pd(w[0], x[0]),
+                                                            _mm_set1_pd(0.5)));
+        const __m128i d = rgbSquaredDistanceLanes(meanRed,
+                                                  _mm_cvttpd_epi32(_mm_sub_pd(w[0], x[0])),
+                                                  _mm_cvttpd_epi32(_mm_sub_pd(w[1], x[1])),
+                                                  _mm_cvttpd_epi32(_mm_sub_pd(w[2], x[2])));
+        _mm_storel_epi64((__m128i *)(squared + k), d);
+    }
+    rgbSquaredDistancesScalar(input, inputStep, weights, K - k, squared + k);
+}
+
+// 4 interleaved rgb vectors [a0 a1 a2 b0 | b1 b2 c0 c1 | c2 d0 d1 d2] into
+// [a0 b0 c0 d0] [a1 b1 c1 d1] [a2 b2 c2 d2], by 128 bit halves
+__attribute__((target("avx2")))
+inline void loadRgb4(const double * v, __m256d * c)
+{
+    const __m256d m0 = _mm256_loadu2_m128d(v + 6, v);      // a0 a1 | c0 c1
+    const __m256d m1 = _mm256_loadu2_m128d(v + 8, v + 2);  // a2 b0 | c2 d0
+    const __m256d m2 = _mm256_loadu2_m128d(v + 10, v + 4); // b1 b2 | d1 d2
+    c[0] = _mm256_blend_pd(m0, m1, 10);
+    c[1] = _mm256_shuffle_pd(m0, m2, 5);
+    c[2] = _mm256_blend_pd(m1, m2, 10);
+}
+
+__attribute__((target("avx2")))
+inline void rgbSquaredDistancesAvx2(const double * input, const int inputStep,
+                                    const double * weights, const int K, int * squared)
+{
+    __m256d x[3];
+    for (int c = 0; c < 3; c++)
+        x[c] = _mm256_set1_pd(input[c]);
+    int k = 0;
+    for (/**/; k + 4 <= K; k += 4, input += 4 * inputStep, weights += 12)
+    {
+        if (inputStep != 0)
+            loadRgb4(input, x);
+        __m256d w[3];
+        loadRgb4(weights, w);
+        const __m128i meanRed = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_add_pd(w[0], x[0]),
+                                                                  _mm256_set1_pd(0.5)));
+        const __m128i d = rgbSquaredDistanceLanes(
+            meanRed, _mm256_cvttpd_epi32(_mm256_sub_pd(w[0], x[0])),
+            _mm256_cvttpd_epi32(_mm256_sub_pd(w[1], x[1])),
+            _mm256_cvttpd_epi32(_mm256_sub_pd(w[2], x[2])));
+        _mm_storeu_si128((__m128i *)(squared + k), d);
+    }
+    rgbSquaredDistancesSse4(input, inputStep, weights, K - k, squared + k);
+}
+#endif // VECTOR_SPACE_X86
+
+// the best kernel this cpu runs, or 'level' if it is lower
+inline VECTOR_KERNEL_LEVEL
+getVectorKernelLevel(const VECTOR_KERNEL_LEVEL level = VECTOR_KERNEL_AVX2)
+{
+#ifdef VECTOR_SPACE_X86
+    static const VECTOR_KERNEL_LEVEL cpuLevel =
+        __builtin_cpu_supports("avx2") ? VECTOR_KERNEL_AVX2 :
+        (__builtin_cpu_supports("sse4.1") ? VECTOR_KERNEL_SSE4 : VECTOR_KERNEL_SCALAR);
+#else
+    static const VECTOR_KERNEL_LEVEL cpuLevel = VECTOR_KERNEL_SCALAR;
+#endif
+    return level < cpuLevel ? level : cpuLevel;
+}
+
+template <typename T>
+void rgbSquaredDistances(const T * input, const int inputStep, const T * weights,
+                         const int K, int * squared)
+{
+    rgbSquaredDistancesScalar(input, inputStep, weights, K, squared);
+}
+
+inline void rgbSquaredDistances(const double * input, const int inputStep,
+                                const double * weights, const int K, int * squared,
+                                const VECTOR_KERNEL_LEVEL level = VECTOR_KERNEL_AVX2)
+{
+    switch (getVectorKernelLevel(level))
+    {
+#ifdef VECTOR_SPACE_X86
+    case VECTOR_KERNEL_AVX2:
+        rgbSquaredDistancesAvx2(input, inputStep, weights, K, squared);
+        break;
+    case VECTOR_KERNEL_SSE4:
+        rgbSquaredDistancesSse4(input, inputStep, weights, K, squared);
+        break;
+#endif
+    default:
+        rgbSquaredDistancesScalar(input, inputStep, weights, K, squared);
+        break;
+    }
+}
+
+// the distances themselves: the square roots of the above
+template <typename T>
+void rgbEulerDistances(const T * input, const int inputStep, const T * weights, const int K,
+                       double * distances)
+{
+    enum {BLOCK = 16};
+    int squared[BLOCK];
+    for (int k = 0; k < K; k += BLOCK)
+    {
+        const int n = K - k < BLOCK ? K - k : BLOCK;
+        rgbSquaredDistances(input + k * inputStep, inputStep, weights + k * 3, n, squared);
+        for (int m = 0; m < n; m++)
+            distances[k + m] = sqrt(squared[m]);
+    }
+}
+
+// 0, 1, .. N - 1 as a type, for the fixed VectorSpace's component wise constexpr ops
+template <int... Is> struct IndexList {};
+template <int N, int... Is> struct MakeIndexList : MakeIndexList<N - 1, N - 1, Is...> {};
+template <int... Is> struct MakeIndexList<0, Is...> {typedef IndexList<Is...> type;};
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+// VectorSpace arithmetic builds expressions instead of temporaries: an expression is read
+// component by component only when a VectorSpace is constructed from or assigned it, so
+// a whole update like 'w = w + ((x - w) * rate)' is one loop without temporaries. They
+// keep references to their operands, so they only live within the full expression.
+template <typename E>
+class VectorExpression
 {
 public:
+    constexpr const E & self() const {return static_cast<const E &>(*this);}
+    void dumpComponents() const
+    {
+        for (int k = 0; k < self().size(); k++)
+            std::cout << self()[k] << " ";
+        std::cout << std::endl;
+    }
+};
+
+struct VectorPlus {template <typename T> static constexpr T apply(T a, T b) {return a + b;}};
+struct VectorMinus {template <typename T> static constexpr T apply(T a, T b) {return a - b;}};
+struct VectorTimes {template <typename T> static constexpr T apply(T a, T b) {return a * b;}};
+struct VectorDivides {template <typename T> static constexpr T apply(T a, T b) {return a / b;}};
+
+// component wise 'e1 op e2'
+template <typename E1, typename E2, typename Op>
+class VectorBinaryExpression : public VectorExpression<VectorBinaryExpression<E1, E2, Op> >
+{
+public:
+    typedef typename E1::value_type value_type;
+    constexpr VectorBinaryExpression(const E1 & e1, const E2 & e2) : m_e1(e1), m_e2(e2) {}
+    constexpr int size() const {return m_e1.size();}
+    constexpr bool isConsistent() const
+    {
+        return m_e1.size() == m_e2.size() && m_e1.isConsistent() && m_e2.isConsistent();
+    }
+    constexpr value_type operator[](const int k) const
+    {
+        return Op::template apply<value_type>(m_e1[k], m_e2[k]);
+    }
+
+private:
+    const E1 & m_e1;
+    const E2 & m_e2;
+};
+
+// each component 'op scalar'
+template <typename E, typename Op>
+class VectorScalarExpression : public VectorExpression<VectorScalarExpression<E, Op> >
+{
+public:
+    typedef typename E::value_type value_type;
+    constexpr VectorScalarExpression(const E & e, const value_type scalar)
+        : m_e(e), m_scalar(scalar)
+    {
+    }
+    constexpr int size() const {return m_e.size();}
+    constexpr bool isConsistent() const {return m_e.isConsistent();}
+    constexpr value_type operator[](const int k) const
+    {
+        return Op::template apply<value_type>(m_e[k], m_scalar);
+    }
+
+private:
+    const E & m_e;
+    const value_type m_scalar;
+};
+
+template <typename E1, typename E2>
+constexpr VectorBinaryExpression<E1, E2, VectorPlus>
+operator+(const VectorExpression<E1> & e1, const VectorExpression<E2> & e2)
+{
+    return VectorBinaryExpression<E1, E2, VectorPlus>(e1.self(), e2.self());
+}
+
+template <typename E1, typename E2>
+constexpr VectorBinaryExpression<E1, E2, VectorMinus>
+operator-(const VectorExpression<E1> & e1, const VectorExpression<E2> & e2)
+{
+    return VectorBinaryExpression<E1, E2, VectorMinus>(e1.self(), e2.self());
+}
+
+template <typename E>
+constexpr VectorScalarExpression<E, VectorTimes>
+operator*(const VectorExpression<E> & e, const typename E::value_type scaler)
+{
+    return VectorScalarExpression<E, VectorTimes>(e.self(), scaler);
+}
+
+template <typename E>
+constexpr VectorScalarExpression<E, VectorDivides>
+operator/(const VectorExpression<E> & e, const typename E::value_type divisor)
+{
+    return VectorScalarExpression<E, VectorDivides>(e.self(), divisor);
+}
+
+// the sum of the squared components from the k-th on
+template <typename E>
+constexpr typename E::value_type squaredNorm(const VectorExpression<E> & e, const int k = 0)
+{
+    return k == e.self().size() ? typename E::value_type() :
+           e.self()[k] * e.self()[k] + squaredNorm(e, k + 1);
+}
+
+// VectorSpace<T> keeps its components in a vector, of any size; VectorSpace<T, N> keeps
+// N of them inline (see below).
+template <typename T, int N = VECTOR_DYNAMIC>
+class VectorSpace;
+
+template <typename T>
+class VectorSpace<T, VECTOR_DYNAMIC> : public VectorExpression<VectorSpace<T> >
+{
+public:
+    typedef T value_type;
     explicit VectorSpace(const vector<T> & initVector)
         : m_components(initVector)
     {
         return;
     }
+    // the expression's one loop, into the one vector
+    template <typename E>
+    VectorSpace(const VectorExpression<E> & expression)
+        : m_components(expression.self().size())
+    {
+        assign(expression.self());
+        return;
+    }
+    template <typename E>
+    VectorSpace<T> & operator=(const VectorExpression<E> & expression)
+    {
+        m_components.resize(expression.self().size());
+        assign(expression.self());
+        return *this;
+    }
     //// copy constructor
     //VectorSpace(const VectorSpace<T> & vs)
     //{
@@ -38,26 +347,19 @@ public:
         return VectorSpace<T>(vectorDotProduct(vs2.components()));
     }
 
-    VectorSpace<T> operator*(const T scaler) const
-    {
-        return VectorSpace<T>(vectorScale(scaler));
-    }
-
-    VectorSpace<T> operator+(const VectorSpace<T> & vs2) const
-    {
-        return VectorSpace<T>(vectorAdd(vs2.components()));
-    }
-
-    VectorSpace<T> operator-(const VectorSpace<T> & vs2) const 
-    {
-        return VectorSpace<T>(vectorMinus(vs2.components()));
-    }
-
     // helpers    
     static double generalEulerDistance(const VectorSpace<T> & vs1, const VectorSpace<T> & vs2)
     {
         return vectorEuler(vs1.components(), vs2.components());
     }
+    // the input against K weight vectors in one call
+    static void generalEulerDistances(const VectorSpace<T> & input,
+                                      const VectorSpace<T> * weights, const int K,
+                                      double * distances)
+    {
+        for (int k = 0; k < K; k++)
+            distances[k] = vectorEuler(weights[k].components(), input.components());
+    }
     // rgb distance
     static double rgbEulerDistance1(const VectorSpace<T> & vs1, const VectorSpace<T> & vs2)
     {
@@ -82,15 +384,24 @@ public:
         }
         */
         assert(vs1.components().size() == 3 && vs2.components().size() == 3);
-        int meanRed = (vs1.components()[0] + vs2.components()[0]) / 2;
-        int r =  vs1.components()[0] - vs2.components()[0];
-        int g =  vs1.components()[1] - vs2.components()[1];
-        int b =  vs1.components()[2] - vs2.components()[2];
-        return sqrt((((512 + meanRed)*r*r)>>8) + 4*g*g + (((767-meanRed)*b*b)>>8));
+        return rgbEulerDistance(&vs1.components()[0], &vs2.components()[0]);
+    }
+    // the same formular on raw components, for planar storage that keeps no VectorSpace
+    static double rgbEulerDistance(const T * v1, const T * v2)
+    {
+        int meanRed = (v1[0] + v2[0]) / 2;
+        int r =  v1[0] - v2[0];
+        int g =  v1[1] - v2[1];
+        int b =  v1[2] - v2[2];
+        return sqrt(Vector_Space::rgbSquaredDistance(meanRed, r, g, b));
     }
 
     const vector<T> & components() const {return m_components;}
     int dimention() {return (int)m_components.size();}
+    // as an expression operand
+    int size() const {return (int)m_components.size();}
+    bool isConsistent() const {return true;}
+    const T & operator[](const int k) const {return m_components[k];}
     void dumpComponents()
     {
         for (int k = 0; k < (int)m_components.size(); k++) 
@@ -109,7 +420,10 @@ private:
         assert(v1.size() == v2.size());
         double result = 0.0;
         for (int k = 0; k < (int) v1.size(); k++)
-            result += pow((double)(v1[k] - v2[k]), 2.0);
+        {
+            const double d = (double)(v1[k] - v2[k]);
+            result += d * d;
+        }
         return sqrt(result);
     }
 
@@ -122,30 +436,138 @@ private:
         return result;
     }
 
-    vector<T> vectorScale(const T scaler) const
+    // component k of an expression only reads its operands' k-th components, so the
+    // operands may be this vector
+    template <typename E>
+    void assign(const E & expression)
     {
-        vector<T> result;
-        for (int k = 0; k < (int)m_components.size(); k++) 
-            result.push_back(m_components[k] * scaler);
-        return result;
+        assert(expression.isConsistent());
+        for (int k = 0; k < (int)m_components.size(); k++)
+            m_components[k] = expression[k];
     }
+};
 
-    vector<T> vectorAdd(const vector<T> & v2) const
+//////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+// N components in a std::array: no heap, so it can be a neuron's weight vector & the
+// operands of the per pixel loops. The arithmetic is constexpr, the distances are the sqrt
+// of the constexpr squared ones (sqrt is not).
+template <typename T, int N>
+class VectorSpace : public VectorExpression<VectorSpace<T, N> >
+{
+public:
+    static_assert(N > 0, "a fixed size VectorSpace has components");
+    typedef T value_type;
+    constexpr VectorSpace() : m_components() {}
+    constexpr explicit VectorSpace(const std::array<T, N> & components)
+        : m_components(components)
     {
-        vector<T> result;
-        assert(m_components.size() == v2.size());
-        for (int k = 0; k < (int)m_components.size(); k++)
-            result.push_back(m_components[k] + v2[k]);
-        return result;
     }
+    // one value a component
+    template <typename... Ts>
+    constexpr explicit VectorSpace(const T first, const Ts... rest)
+        : m_components{{first, (T)rest...}}
+    {
+        static_assert(sizeof...(Ts) + 1 == N, "one value a component");
+    }
+    // the expression's components, with no loop left in the code
+    template <typename E>
+    constexpr VectorSpace(const VectorExpression<E> & expression)
+        : VectorSpace(expression.self(), typename MakeIndexList<N>::type())
+    {
+    }
+    // all components are read before any is stored, so the operands may be this vector,
+    // and the compiler needn't assume they alias it in between
+    template <typename E>
+    VectorSpace & operator=(const VectorExpression<E> & expression)
+    {
+        m_components = VectorSpace(expression).m_components;
+        return *this;
+    }
+
+    // read only (a non const one can't be constexpr in C++11): assign whole vectors
+    constexpr const T & operator[](const int k) const {return m_components[k];}
+
+    constexpr T innerProduct(const VectorSpace & vs2) const {return dotFrom(vs2, 0);}
 
-    vector<T> vectorMinus(const vector<T> & v2) const
+    // helpers
+    static constexpr T squaredEulerDistance(const VectorSpace & vs1, const VectorSpace & vs2)
     {
-        vector<T> result;
-        assert(m_components.size() == v2.size());
-        for (int k = 0; k < (int)m_components.size(); k++)
-            result.push_back(m_components[k] - v2[k]);
-        return result;
+        return squaredNorm(vs1 - vs2);
+    }
+    static double generalEulerDistance(const VectorSpace & vs1, const VectorSpace & vs2)
+    {
+        return sqrt((double)squaredEulerDistance(vs1, vs2));
+    }
+    // rgb distance, the same formular & integer truncation as VectorSpace<T>'s
+    static constexpr int rgbSquaredDistance(const VectorSpace & v1, const VectorSpace & v2)
+    {
+        static_assert(N == 3, "rgb has 3 components");
+        return Vector_Space::rgbSquaredDistance((int)((v1[0] + v2[0]) / 2),
+                                                (int)(v1[0] - v2[0]), (int)(v1[1] - v2[1]),
+                                                (int)(v1[2] - v2[2]));
+    }
+    static double rgbEulerDistance(const VectorSpace & v1, const VectorSpace & v2)
+    {
+        return sqrt(rgbSquaredDistance(v1, v2));
+    }
+    // batched: the input against K contiguous weight vectors, or the k-th input against
+    // the k-th weight vector, by the SIMD kernels above when T is double
+    static void rgbSquaredDistances(const VectorSpace & input, const VectorSpace * weights,
+                                    const int K, int * squared)
+    {
+        static_assert(N == 3 && sizeof(VectorSpace) == sizeof(T) * N, "contiguous rgb");
+        Vector_Space::rgbSquaredDistances(input.m_components.data(), 0,
+                                          weights->m_components.data(), K, squared);
+    }
+    static void rgbSquaredDistances(const VectorSpace * inputs, const VectorSpace * weights,
+                                    const int K, int * squared)
+    {
+        static_assert(N == 3 && sizeof(VectorSpace) == sizeof(T) * N, "contiguous rgb");
+        Vector_Space::rgbSquaredDistances(inputs->m_components.data(), N,
+                                          weights->m_components.data(), K, squared);
+    }
+    static void rgbEulerDistances(const VectorSpace & input, const VectorSpace * weights,
+                                  const int K, double * distances)
+    {
+        static_assert(N == 3 && sizeof(VectorSpace) == sizeof(T) * N, "contiguous rgb");
+        Vector_Space::rgbEulerDistances(input.m_components.data(), 0,
+                                        weights->m_components.data(), K, distances);
+    }
+    static void rgbEulerDistances(const VectorSpace * inputs, const VectorSpace * weights,
+                                  const int K, double * distances)
+    {
+        static_assert(N == 3 && sizeof(VectorSpace) == sizeof(T) * N, "contiguous rgb");
+        Vector_Space::rgbEulerDistances(inputs->m_components.data(), N,
+                                        weights->m_components.data(), K, distances);
+    }
+    static void squaredEulerDistances(const VectorSpace & input, const VectorSpace * weights,
+                                      const int K, T * squared)
+    {
+        for (int k = 0; k < K; k++)
+            squared[k] = squaredEulerDistance(weights[k], input);
+    }
+
+    constexpr const std::array<T, N> & components() const {return m_components;}
+    constexpr int dimention() const {return N;}
+    // as an expression operand
+    constexpr int size() const {return N;}
+    constexpr bool isConsistent() const {return true;}
+
+private:
+    std::array<T, N> m_components;
+
+private:
+    // helpers (constexpr functions are a single return statement)
+    template <typename E, int... Is>
+    constexpr VectorSpace(const E & expression, IndexList<Is...>)
+        : m_components{{expression[Is]...}}
+    {
+    }
+
+    constexpr T dotFrom(const VectorSpace & vs2, const int k) const
+    {
+        return k == N ? T() : m_components[k] * vs2.m_components[k] + dotFrom(vs2, k + 1);
     }
 };
 